@@ -14,7 +14,8 @@
 #include "stat.h"
 
 namespace jyq {
-    struct CFid {
+    struct Client;
+    struct CFid : public std::enable_shared_from_this<CFid> {
         public:
             CFid() = default;
             constexpr auto getFid() const noexcept { return _fid; }
@@ -30,6 +31,9 @@ namespace jyq {
             void setMode(uint8_t value) noexcept { _mode = value; }
             void setQid(const Qid& value) noexcept { _qid = value; }
             void setFid(uint32_t value) noexcept { _fid = value; }
+            /* the client this fid belongs to, for transfers which pipeline their requests */
+            Client* getClient() const noexcept { return _client; }
+            void setClient(Client* value) noexcept { _client = value; }
             bool close(DoFcallFunc);
             bool clunk(DoFcallFunc); 
             bool performClunk(DoFcallFunc);
@@ -38,6 +42,11 @@ namespace jyq {
             long pwrite(const void*, long, int64_t, DoFcallFunc);
             long write(const void*, long, DoFcallFunc);
             std::shared_ptr<Stat> fstat(DoFcallFunc);
+            /* the asynchronous calls of the client, for this fid */
+            void async_pread(void*, long, int64_t, std::function<void(long)>);
+            void async_pwrite(const void*, long, int64_t, std::function<void(long)>);
+            void async_stat(std::function<void(std::shared_ptr<Stat>)>);
+            void async_clunk(std::function<void(bool)>);
             [[nodiscard]] Lock getIoLock() { return Lock(_iolock); }
         private:
             uint32_t _fid;
@@ -46,7 +55,8 @@ namespace jyq {
             bool     _open;
             uint     _iounit;
             uint32_t _offset;
-            mutable Mutex _iolock;
+            Client*  _client = nullptr;
+            mutable Mutex _iolock JYQ_LOCK_NAME("CFid::_iolock");
     };
 } // end namespace jyq
 #endif // end LIBJYQ_CFID_H__
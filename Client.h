@@ -4,16 +4,26 @@
  */
 #ifndef LIBJYQ_CLIENT_H__
 #define LIBJYQ_CLIENT_H__
+#include <atomic>
+#include <chrono>
 #include <string>
 #include <functional>
+#include <future>
 #include <list>
 #include <memory>
+#include <thread>
+#include <vector>
 #include "types.h"
+#include "dircache.h"
+#include "diskcache.h"
 #include "Msg.h"
+#include "pagecache.h"
 #include "Fcall.h"
 #include "Rpc.h"
 #include "stat.h"
+#include "statcache.h"
 #include "socket.h"
+#include "tagpool.h"
 
 namespace jyq {
     struct CFid;
@@ -39,25 +49,43 @@ namespace jyq {
         private:
             //int     fd;
             Connection fd;
-            uint    _lastfid;
-            uint    _freetag;
-            uint    _msize;
-            uint    _nwait;
-            uint    _mwait;
+            uint    _lastfid = 0;
+            uint    _msize = 0;
             std::list<std::shared_ptr<CFid>> _freefid;
             Msg     _rmsg;
             Msg     _wmsg;
-            mutable Mutex	_lk;
-            mutable Mutex	_rlock;
-            mutable Mutex	_wlock;
+            mutable Mutex	_lk JYQ_LOCK_NAME("Client::_lk");
+            mutable Mutex	_rlock JYQ_LOCK_NAME("Client::_rlock");
+            mutable Mutex	_wlock JYQ_LOCK_NAME("Client::_wlock");
             mutable Rendez	_tagrend;
+            /* threads blocked in gettag, woken by puttag */
+            std::atomic<uint> _tagwaiters { 0 };
+            /* threads blocked in await, woken by finish and once nobody reads replies */
+            mutable Rendez  _awaitrend;
+            std::atomic<uint> _awaiters { 0 };
+            uint64_t _completions = 0; /* completions run so far */
         public:
-            std::vector<Rpc> wait;
+            TagPool<Rpc> wait { 0 };
             Rpc::weak_type muxer;
             Rpc         sleep;
         private:
-            int		_mintag;
-            int		_maxtag;
+            int		_mintag = 0;
+            int		_maxtag = 0;
+            /* stands in as the muxer while a thread is in poll */
+            Rpc     _poller;
+            /* and for good once the reader thread is running */
+            Rpc     _readrpc;
+            /* the thread holding the muxer role, if it took it itself */
+            std::thread::id _muxthread;
+            std::thread _reader;
+            std::atomic<size_t> _window { 4 };
+            size_t  _maxWindow = 64;
+            std::unique_ptr<PageCache> _cache;
+            std::unique_ptr<DiskCache> _disk;
+            /* what mount dialed, naming the server to the disk cache */
+            std::string _address;
+            std::unique_ptr<StatCache> _stats;
+            std::unique_ptr<DirCache> _dirs;
         public:
             bool remove(const char*);
             std::shared_ptr<CFid> create(const char*, uint perm, uint8_t mode);
@@ -76,20 +104,182 @@ namespace jyq {
             std::shared_ptr<CFid> walk(const std::string&);
             std::shared_ptr<CFid> walkdir(char *path, const char **rest);
             std::shared_ptr<Fcall> dofcall(Fcall& fcall);
+            std::vector<std::shared_ptr<Fcall>> dofcalls(std::vector<Fcall>& fcalls);
+            /* the paths statMany has in flight at once */
+            static constexpr size_t StatBatch = 64;
+            std::string readFile(const std::string& path);
+            long writeFile(const std::string& path, const std::string& data);
+            std::vector<std::shared_ptr<Stat>> statMany(const std::vector<std::string>& paths);
+            std::vector<std::shared_ptr<Stat>> readDir(const std::string& path);
             void enqueue(Rpc&);
             void dequeue(Rpc&);
             void putfid(std::shared_ptr<CFid> cfid);
             void clunk(std::shared_ptr<CFid> fid);
             inline DoFcallFunc getDoFcallLambda() noexcept { return [this](auto& ptr) { return dofcall(ptr); }; }
-            int gettag(Rpc* r, Lock& lock) { return gettag(*r, lock); }
-            int gettag(Rpc& r, Lock& lock);
+            int gettag(Rpc* r) { return gettag(*r); }
+            int gettag(Rpc& r);
             void puttag(Rpc& r);
             void puttag(Rpc* r) { return puttag(*r); }
-            bool sendrpc(Rpc& r, Fcall& f);
+            void settags(int min, int max);
+            bool sendrpc(Rpc& r, Fcall& f, const char* payload = nullptr);
+            bool send(Fcall& f, const char* payload, std::vector<Rpc>& finished);
+        public:
+            using Completion = RpcBody::Completion;
+            template<typename T>
+            using Callback = std::function<void(T)>;
+            bool asyncrpc(Fcall& tx, Completion done, const char* payload = nullptr);
+            bool asyncread(Fcall& tread, char* into, Completion done);
+            bool poll();
+            void startReader();
+            bool hasReader() const noexcept { return _reader.joinable(); }
+            /**
+             * Function: await
+             *
+             * Read replies with F<poll> until P<result> is ready, then
+             * return its value. While another thread reads them, it
+             * sleeps until a completion has run or that thread stops.
+             */
+            template<typename T>
+            T await(std::future<T>& result) {
+                using namespace std::chrono_literals;
+                auto ready = [&result] { return result.wait_for(0s) == std::future_status::ready; };
+                while (!ready()) {
+                    if (!poll()) {
+                        awaitturn(ready);
+                    }
+                }
+                return result.get();
+            }
+            void awaitturn(const std::function<bool()>& ready);
+            /**
+             * Function: setWindow
+             *
+             * A pread or pwrite larger than the fid's iounit keeps up to
+             * a window of requests outstanding at consecutive offsets.
+             * Each transfer starts with the window the previous one
+             * ended with, P<initial> for the first, and adapts it
+             * between 1 and P<maximum>, see F<async_pread>. As every
+             * outstanding request holds a tag, P<maximum> is capped at
+             * the tags the client has, so call it after mounting.
+             */
+            void setWindow(size_t initial, size_t maximum) noexcept;
+            size_t getWindow() const noexcept { return _window.load(std::memory_order_relaxed); }
+            size_t getMaxWindow() const noexcept { return _maxWindow; }
+            void setLearnedWindow(size_t value) noexcept { _window.store(value, std::memory_order_relaxed); }
+            /**
+             * Function: setCache
+             *
+             * Keep up to P<budget> bytes of the files read through this
+             * client in a T<PageCache>, see F<pread>. Writes, truncating
+             * opens and removes made through the client drop the blocks
+             * of their file, see F<invalidateCache>. The first call must
+             * come before the client is shared between threads; later
+             * ones only change the budget, and a budget of 0 stops
+             * caching.
+             */
+            void setCache(size_t budget);
+            PageCache* getCache() noexcept { return _cache.get(); }
+            /**
+             * Function: setDiskCache
+             *
+             * Keep up to P<budget> bytes of the files read through this
+             * client in a T<DiskCache> in P<dir> as well, behind the
+             * page cache, so that later processes find them there.
+             * Blocks are kept apart by P<server>, the address the
+             * client was mounted with by default; clients made with
+             * mountfd should name their server. Raises an error if the
+             * store cannot be opened. A budget of 0 closes it. Like
+             * F<setCache>, it must be called before the client is
+             * shared between threads.
+             */
+            void setDiskCache(const std::string& dir, size_t budget, const std::string& server = "");
+            DiskCache* getDiskCache() noexcept { return _disk.get(); }
+            const std::string& getAddress() const noexcept { return _address; }
+            void invalidateCache(uint64_t path);
+            /**
+             * Function: setStatCache
+             *
+             * Keep the results of F<stat>, F<statMany> and F<readDir>
+             * in a T<StatCache> for P<ttl> milliseconds, so that
+             * stating a path again within that time takes no request.
+             * Changes made through the client drop the entries they
+             * affect; those made by others go unnoticed until the
+             * entry expires or a walk finds another qid. The first
+             * call must come before the client is shared between
+             * threads; later ones only change the ttl, and a ttl of 0
+             * stops caching.
+             */
+            void setStatCache(uint64_t ttl);
+            StatCache* getStatCache() noexcept { return _stats.get(); }
+            /**
+             * Function: setDirCache
+             *
+             * Keep up to P<limit> fids walked to directories in a
+             * T<DirCache>. Walks then start from the deepest cached
+             * directory above their path and send only the rest of it,
+             * and walk to the parent of their path on the way, so
+             * that the walks to its siblings send a single name. The
+             * first call must come before the client is shared between
+             * threads; later ones only change the limit, and a limit
+             * of 0 stops caching.
+             */
+            void setDirCache(size_t limit);
+            DirCache* getDirCache() noexcept { return _dirs.get(); }
+            void async_walk(const std::string& path, Callback<std::shared_ptr<CFid>> done);
+            void async_open(const std::string& path, uint8_t mode, Callback<std::shared_ptr<CFid>> done);
+            void async_pread(std::shared_ptr<CFid> fid, void* buf, long count, int64_t offset, Callback<long> done);
+            void async_pwrite(std::shared_ptr<CFid> fid, const void* buf, long count, int64_t offset, Callback<long> done);
+            void async_stat(std::shared_ptr<CFid> fid, Callback<std::shared_ptr<Stat>> done);
+            void async_stat(const std::string& path, Callback<std::shared_ptr<Stat>> done);
+            void async_clunk(std::shared_ptr<CFid> fid, Callback<bool> done);
+            auto async_walk(const std::string& path) {
+                return deferred<std::shared_ptr<CFid>>([&](auto done) { async_walk(path, done); });
+            }
+            auto async_open(const std::string& path, uint8_t mode) {
+                return deferred<std::shared_ptr<CFid>>([&](auto done) { async_open(path, mode, done); });
+            }
+            auto async_open(const std::string& path, OMode mode) { return async_open(path, uint8_t(mode)); }
+            auto async_pread(std::shared_ptr<CFid> fid, void* buf, long count, int64_t offset) {
+                return deferred<long>([&](auto done) { async_pread(fid, buf, count, offset, done); });
+            }
+            auto async_pwrite(std::shared_ptr<CFid> fid, const void* buf, long count, int64_t offset) {
+                return deferred<long>([&](auto done) { async_pwrite(fid, buf, count, offset, done); });
+            }
+            auto async_stat(std::shared_ptr<CFid> fid) {
+                return deferred<std::shared_ptr<Stat>>([&](auto done) { async_stat(fid, done); });
+            }
+            auto async_stat(const std::string& path) {
+                return deferred<std::shared_ptr<Stat>>([&](auto done) { async_stat(path, done); });
+            }
+            auto async_clunk(std::shared_ptr<CFid> fid) {
+                return deferred<bool>([&](auto done) { async_clunk(fid, done); });
+            }
+        private:
+            /* start an asynchronous operation with a completion that fulfils the returned future */
+            template<typename T, typename Start>
+            static std::future<T> deferred(Start start) {
+                auto promise = std::make_shared<std::promise<T>>();
+                auto result = promise->get_future();
+                start(Callback<T>([promise](T value) { promise->set_value(std::move(value)); }));
+                return result;
+            }
+            uint iounit(uint suggested) const noexcept;
+            using WalkResult = std::pair<std::shared_ptr<CFid>, std::string>;
+            void walkchain(const std::string& path, bool cached, Callback<WalkResult> done);
+            void async_fcalls(std::vector<Fcall>& fcalls, Callback<std::vector<std::shared_ptr<Fcall>>> done);
         private:
             std::unique_ptr<Fcall> muxrecv();
             void electmuxer();
-            void dispatchandqlock(std::shared_ptr<Fcall> f, Lock&);
+            Rpc dispatchandqlock(std::shared_ptr<Fcall> f, Lock&);
+            void finish(Rpc& r, Lock& lock);
+            void failasync(Lock& lock);
+            void stalled(std::vector<Rpc>& finished);
+            bool asyncsend(Rpc& r, Fcall& tx, Completion done, const char* payload);
+            bool readone(Lock& lk, std::vector<Rpc>* later);
+            void takemuxer(const Rpc& r);
+            /* with the lock held */
+            bool holdsmuxer() const noexcept { return _muxthread == std::this_thread::get_id(); }
+            void readloop();
             void allocmsg(int n);
     };
 } // end namespace jyq
@@ -29,6 +29,7 @@ namespace jyq {
         void setClosed(bool value = true) noexcept { _closed = value; }
         uint recvmsg(Msg& msg) { return getConnection().recvmsg(msg); }
         uint sendmsg(Msg& msg) { return getConnection().sendmsg(msg); }
+        uint sendmsg(MsgChain& chain) { return getConnection().sendmsg(chain); }
         const auto& getServer() const noexcept { return _srv; }
         auto& getServer() noexcept { return _srv; }
 
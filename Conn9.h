@@ -14,6 +14,7 @@
 #include "Fcall.h"
 #include "stat.h"
 #include "map.h"
+#include "tagtable.h"
 #include "Conn.h"
 #include "Srv9.h"
 #include "Fid.h"
@@ -23,9 +24,10 @@ namespace jyq {
 struct Srv9;
 struct Conn9 {
     public:
-        using TagMap = jyq::Map<uint16_t, Req9>;
+        using TagMap = TagTable<Req9>;
     public:
         Conn9() = default;
+        explicit Conn9(Fid::Map::Mode mode) : _fidmap(mode) { }
         ~Conn9() = default;
         Fid::Map& getFidMap() noexcept { return _fidmap; }
         TagMap& getTagMap() noexcept { return _tagmap; }
@@ -43,23 +45,24 @@ struct Conn9 {
         bool removeTag(uint16_t id);
         bool removeFid(int id);
         template<typename T>
-            void tagExec(std::function<void(T, TagMap::iterator)> op, T context) {
+            void tagExec(std::function<void(T, Req9&)> op, T context) {
                 _tagmap.exec<T>(op, context);
             }
         template<typename T>
-            void fidExec(std::function<void(T, Fid::Map::iterator)> op, T context) {
+            void fidExec(std::function<void(T, Fid&)> op, T context) {
                 _fidmap.exec<T>(op, context);
             }
 
         uint sendmsg() { return getConn()->sendmsg(_wmsg); }
+        uint sendmsg(MsgChain& chain) { return getConn()->sendmsg(chain); }
         uint recvmsg() { return getConn()->recvmsg(_rmsg); }
     private:
         TagMap    _tagmap;
         Fid::Map  _fidmap;
         Srv9*   _srv;
         Conn*	_conn;
-        mutable Mutex	_rlock;
-        mutable Mutex	_wlock;
+        mutable Mutex	_rlock JYQ_LOCK_NAME("Conn9::_rlock");
+        mutable Mutex	_wlock JYQ_LOCK_NAME("Conn9::_wlock");
         Msg		_rmsg;
         Msg		_wmsg;
 };
@@ -8,6 +8,8 @@
 #include <array>
 #include <functional>
 #include <memory>
+#include <optional>
+#include <string_view>
 #include <variant>
 #include "types.h"
 #include "qid.h"
@@ -127,16 +129,27 @@ namespace jyq {
             std::string		_name;
             uint8_t		_mode; /* +Topen */
     };
+    /**
+     * The walk names of a TWalk are kept back to back in a single
+     * string which acts as a per-message arena, so a walk costs one
+     * (usually inline) buffer rather than maximum::Welem strings.
+     */
     class FTWalk : public FHdr, public ContainsSizeParameter<uint16_t>  {
         public:
+            FTWalk() : ContainsSizeParameter<uint16_t>(0) { _offsets[0] = 0; }
             constexpr auto getNewFid() const noexcept { return _newfid; }
             void setNewFid(uint32_t value) noexcept { _newfid = value; }
-            auto& getWname() noexcept { return _wname; }
+            std::string_view getWname(size_t index) const noexcept {
+                return std::string_view(_names).substr(_offsets[index], _offsets[index+1] - _offsets[index]);
+            }
+            void addWname(std::string_view value);
+            void clearWnames() noexcept;
             constexpr auto getMaximumWnameCount() const noexcept { return maximum::Welem; }
             void packUnpack(Msg& msg);
         private:
             uint32_t _newfid;
-            std::array<std::string, maximum::Welem> _wname;
+            std::string _names;
+            std::array<uint16_t, maximum::Welem + 1> _offsets;
                 
     };
     class FRWalk : public FHdr, public ContainsSizeParameter<uint16_t> {
@@ -150,15 +163,20 @@ namespace jyq {
     class FIO : public FHdr, public ContainsSizeParameter<uint32_t> {
         public:
             constexpr auto getOffset() const noexcept { return _offset; }
-            const std::string& getData() const noexcept { return _data; }
-            std::string& getData() noexcept { return _data; }
+            const std::string& getData() const noexcept { return _shared ? *_shared : _data; }
+            std::string& getData();
             void setOffset(uint64_t value) noexcept { _offset = value; }
-            void setData(const std::string& value) noexcept { _data = value; }
+            void setData(const std::string& value) { _data = value; _shared.reset(); }
+            /* refer to value instead of copying it, for data several replies carry */
+            void setData(std::shared_ptr<const std::string> value) noexcept { _shared = std::move(value); _data.clear(); }
+            /* the data, moved out rather than copied, leaving none behind */
+            std::shared_ptr<const std::string> takeData();
             void packUnpack(Msg& msg);
-            void reset() { _data.clear(); }
+            void reset() { _data.clear(); _shared.reset(); }
         private: 
             uint64_t  _offset; /* Tread, Twrite */
             std::string _data; /* Twrite, Rread */
+            std::shared_ptr<const std::string> _shared; /* Rread, in place of _data */
     };
     class FRStat : public FHdr, public ContainsSizeParameter<uint16_t> {
         public:
@@ -210,38 +228,25 @@ namespace jyq {
      * RWrite are both represented by FIO and can be accessed via the
      * P<io> member as well as P<tread> and P<rwrite> respectively.
      *
+     * An Fcall is move-only; requests and responses are built in place
+     * and handed along by reference or by move, never copied.
+     *
      * See also:
      *	T<Srv9>, T<Req9>
      */
     struct Fcall {
         using VariantStorage = std::variant<FVersion, FTFlush, FROpen, FError, FRAuth, FAttach, FTCreate,
             FTWalk, FRWalk, FTWStat, FRStat, FIO, FHdr, FFullHeader>;
-        std::optional<VariantStorage> _storage;
-        /*
-        FHdr     _hdr;
-        FVersion _version;
-        FTFlush  _tflush;
-        FROpen   _ropen;
-        FError   _error;
-        FRAuth   _rauth;
-        FAttach  _tattach;
-        FTCreate _tcreate;
-        FTWalk   _twalk;
-        FRWalk   _rwalk;
-        FTWStat  _twstat;
-        FRStat   _rstat;
-        FIO      _io;
-        */
         const FHdr& getHeader() const {
-            if (_storage) {
-                return std::visit([](auto&& value) -> const FHdr& { return value; }, *_storage);
+            if (_header) {
+                return *_header;
             } else {
                 throw Exception("backing storage contains no value!");
             }
         }
         FHdr& getHeader() {
-            if (_storage) {
-                return std::visit([](auto&& value) -> FHdr& { return value; }, *_storage);
+            if (_header) {
+                return *_header;
             } else {
                 throw Exception("backing storage contains no value!");
             }
@@ -282,27 +287,53 @@ namespace jyq {
         auto getType() const { return getHeader().getType(); }
         auto getFid() const { return getHeader().getFid(); }
         auto getTag() const { return getHeader().getTag(); }
+        bool empty() const noexcept { return !_storage; }
         void reset(FType type);
+        void reset(const FHdr& hdr);
         void setFid(uint32_t value) { getHeader().setFid(value); }
         void setTag(uint16_t value) { getHeader().setTag(value); }
         void setNoTag() { setTag(NoTag); }
-        inline static VariantStorage constructBlankStorage(FType type) {
-            FHdr tmp;
-            tmp.setType(type);
-            return constructBlankStorage(tmp);
+        /**
+         * Construct the body of this fcall in place, replacing any
+         * previous contents.
+         */
+        template<typename T, typename ... Args>
+        T& emplace(Args&& ... args) {
+            auto& value = std::get<T>(_storage.emplace(std::in_place_type<T>, std::forward<Args>(args)...));
+            _header = &value;
+            return value;
         }
-        static VariantStorage constructBlankStorage(const FHdr& hdr);
         Fcall() = default;
-        Fcall(FType type) : _storage(constructBlankStorage(type)) { }
+        Fcall(FType type) { reset(type); }
         Fcall(FType type, uint32_t fid) : Fcall(type) {
             setFid(fid);
         }
+        Fcall(const Fcall&) = delete;
+        Fcall(Fcall&& other) noexcept : _storage(std::move(other._storage)) { relinkHeader(); }
+        Fcall& operator=(const Fcall&) = delete;
+        Fcall& operator=(Fcall&& other) noexcept {
+            _storage = std::move(other._storage);
+            relinkHeader();
+            return *this;
+        }
         ~Fcall();
         void packUnpack(Msg& msg);
         template<typename Visitor>
         constexpr decltype(auto) visit(Visitor&& v) {
             return std::visit(v, *_storage);
         }
+        private:
+            void relinkHeader() noexcept {
+                _header = _storage ? &std::visit([](auto&& value) -> FHdr& { return value; }, *_storage) : nullptr;
+            }
+        private:
+            /* 
+             * Every alternative derives from FHdr; keeping a pointer to
+             * the live one means getType/getTag/getFid never dispatch
+             * through std::visit.
+             */
+            FHdr* _header = nullptr;
+            std::optional<VariantStorage> _storage;
     };
     using DoFcallFunc = std::function<std::shared_ptr<Fcall>(Fcall&)>;
 } // end namespace jyq
@@ -13,7 +13,7 @@
 #include "qid.h"
 #include "Fcall.h"
 #include "stat.h"
-#include "map.h"
+#include "fidtable.h"
 
 namespace jyq {
     struct Conn9;
@@ -27,13 +27,21 @@ namespace jyq {
      * store any data which must persist for the life of the open
      * file.
      *
+     * A Fid is move-only and is constructed in place inside its
+     * connection's fid table; P<freefid> is called exactly once, when
+     * the live Fid is destroyed.
+     *
      * See also:
      *	T<Req9>, T<Qid>, T<OMode>
      */
     struct Fid : public HasAux {
         public:
-            using Map = jyq::Map<int, Fid>;
+            using Map = FidTable<Fid>;
             Fid(uint32_t fid, std::shared_ptr<Conn9> c);
+            Fid(const Fid&) = delete;
+            Fid(Fid&&) = default;
+            Fid& operator=(const Fid&) = delete;
+            Fid& operator=(Fid&&) = default;
             ~Fid();
         public:
             [[nodiscard]] auto getConn() noexcept { return _conn; }
@@ -5,8 +5,11 @@
 #ifndef LIBJYQ_MSG_H__
 #define LIBJYQ_MSG_H__
 
+#include <array>
 #include <functional>
 #include <cstring>
+#include <vector>
+#include <sys/uio.h>
 #include "types.h"
 #include "qid.h"
 #include "stat.h"
@@ -63,6 +66,7 @@ namespace jyq {
              */
             void pdata(char**, uint);
             void pdata(std::string&, uint);
+            void pdata(const std::string&, uint); /* packs only */
             void pdata(std::vector<uint8_t>&, uint);
             void pstring(char**);
             void pstring(std::string&);
@@ -305,5 +309,49 @@ namespace jyq {
            }
            Mode _mode; /* MsgPack or MsgUnpack. */
     };
+    /**
+     * Type: MsgChain
+     *
+     * A scatter-gather view of a single 9P message. A chain is an
+     * ordered list of buffer segments: usually a header packed into an
+     * ordinary T<Msg>, followed by payload segments borrowed from the
+     * caller. Only the segments are recorded, the chain never owns
+     * the memory it points at, so every buffer must outlive the
+     * F<sendmsg> or F<recvmsg> call made with it. Twrites and Rreads
+     * are sent this way, from wherever their data already is, and
+     * pipelined Rreads are received into the buffer they were asked
+     * for.
+     *
+     * pack packs P<value> into P<head> as if its payload of
+     * P<length> bytes were present, then chains the packed header
+     * with P<payload> so that the data is never copied into
+     * P<head>. The FIO being packed must have an empty data member
+     * and a size of P<length>, and P<head> must be large enough to
+     * hold the entire message.
+     *
+     * Returns:
+     *	pack returns the size of the complete message on success
+     *	and 0 on failure.
+     * See also:
+     *	T<Msg>, F<sendmsg>, F<recvmsg>
+     */
+    struct MsgChain {
+        public:
+            using Segments = std::vector<iovec>;
+        public:
+            MsgChain() = default;
+            ~MsgChain() = default;
+            void append(char* data, size_t length);
+            void append(const char* data, size_t length) { append(const_cast<char*>(data), length); }
+            void appendHeader(Msg& msg) { append(msg.getData(), msg.getEnd() - msg.getData()); }
+            void clear() noexcept { _segments.clear(); }
+            bool empty() const noexcept { return _segments.empty(); }
+            size_t size() const noexcept;
+            Segments& getSegments() noexcept { return _segments; }
+            const Segments& getSegments() const noexcept { return _segments; }
+            uint pack(Msg& head, Fcall& value, const char* payload, uint length);
+        private:
+            Segments _segments;
+    };
 } // end namespace jyq
 #endif // end LIBJYQ_MSG_H__
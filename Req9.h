@@ -20,12 +20,17 @@ namespace jyq {
     struct Srv9;
     struct Conn9;
     struct Req9 : public HasAux {
+        Req9() = default;
+        Req9(const Req9&) = delete;
+        Req9(Req9&&) = default;
+        Req9& operator=(const Req9&) = delete;
+        Req9& operator=(Req9&&) = default;
         Fcall& getIFcall() noexcept { return _ifcall; }
         const Fcall& getIFcall() const noexcept { return _ifcall; }
         Fcall& getOFcall() noexcept { return _ofcall; }
         const Fcall& getOFcall() const noexcept { return _ofcall; }
-        void setIFcall(const Fcall& value) { _ifcall = value; }
-        void setOFcall(const Fcall& value) { _ofcall = value; }
+        void setIFcall(Fcall&& value) { _ifcall = std::move(value); }
+        void setOFcall(Fcall&& value) { _ofcall = std::move(value); }
         std::shared_ptr<Conn9> getConn() noexcept { return _conn; }
         void setConn(std::shared_ptr<Conn9> value) noexcept { _conn = value; }
         // methods
@@ -40,11 +45,15 @@ namespace jyq {
         auto getNewFid() noexcept { return _newfid; }
         void setOldReq(Req9* value) noexcept { _oldreq = value; }
         auto getOldReq() noexcept { return _oldreq; }
+        /* nsec timestamp of receipt, zero for requests made up by the library */
+        void setReceived(uint64_t value) noexcept { _received = value; }
+        constexpr auto getReceived() const noexcept { return _received; }
         private:
-            Srv9*	_srv;
-            Fid*	_fid;    /* Fid structure corresponding to FHdr.fid */
-            Fid*	_newfid; /* Corresponds to FTWStat.newfid */
-            Req9*	_oldreq; /* For TFlush requests, the original request. */
+            Srv9*	_srv = nullptr;
+            Fid*	_fid = nullptr;    /* Fid structure corresponding to FHdr.fid */
+            Fid*	_newfid = nullptr; /* Corresponds to FTWStat.newfid */
+            Req9*	_oldreq = nullptr; /* For TFlush requests, the original request. */
+            uint64_t _received = 0;
             Fcall	_ifcall; /* The incoming request fcall. */
             Fcall	_ofcall; /* The response fcall, to be filled by handler. */
             std::shared_ptr<Conn9>  _conn;
@@ -13,6 +13,8 @@
 
 namespace jyq {
     struct RpcBody {
+        public:
+            using Completion = std::function<void(std::shared_ptr<Fcall>)>;
         public:
             RpcBody();
             ~RpcBody() = default;
@@ -26,12 +28,41 @@ namespace jyq {
             void setAsync(bool value = true) noexcept { _async = value; }
             void setP(std::shared_ptr<Fcall> value) noexcept { _p = value; }
             auto getP() noexcept { return _p; }
+            void setCompletion(Completion value) { _done = std::move(value); }
+            /* where the data of the Rread goes, see F<asyncread> */
+            void setInto(char* value, size_t length) noexcept { _into = value; _intoLength = length; }
+            char* getInto() const noexcept { return _into; }
+            size_t getIntoLength() const noexcept { return _intoLength; }
+            /**
+             * Ready the rpc to be sent again, once nothing else refers to it.
+             */
+            void reset() noexcept {
+                _tag = 0;
+                _p.reset();
+                _waiting = true;
+                _async = false;
+                _done = nullptr;
+                _into = nullptr;
+                _intoLength = 0;
+            }
+            /**
+             * Hand the reply, or nullptr if the connection was lost, to
+             * the completion of an asynchronous rpc.
+             */
+            void complete() {
+                if (_done) {
+                    _done(_p);
+                }
+            }
         private:
             mutable Rendez	_r;
             uint    _tag;
             std::shared_ptr<Fcall> _p;
             bool _waiting;
             bool _async;
+            Completion _done;
+            char* _into = nullptr;
+            size_t _intoLength = 0;
 
     };
     using BareRpc = DoubleLinkedListNode<RpcBody>;
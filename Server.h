@@ -11,6 +11,7 @@
 #include "types.h"
 #include "Conn.h"
 #include "timer.h"
+#include "watchdog.h"
 
 namespace jyq {
     struct Server : public HasAux {
@@ -44,14 +45,17 @@ namespace jyq {
             const auto getTimer() const noexcept { return _timer; }
             void setTimer(Timer* value) noexcept { _timer = value; }
             [[nodiscard]] Lock getLock() { return Lock(_lk); }
+            Watchdog* getWatchdog() const noexcept { return _watchdog.get(); }
+            void setWatchdog(std::shared_ptr<Watchdog> value) noexcept { _watchdog = value; }
         private:
             ConnList _conns;
-            mutable Mutex	_lk;
-            Timer*	_timer;
+            mutable Mutex	_lk JYQ_LOCK_NAME("Server::_lk");
+            Timer*	_timer = nullptr;
             std::function<void(Server*)> _preselect;
-            bool	_running;
-            int		_maxfd;
+            bool	_running = false;
+            int		_maxfd = 0;
             fd_set		_rd;
+            std::shared_ptr<Watchdog> _watchdog;
         private:
             void prepareSelect();
             void handleConns();
@@ -10,6 +10,7 @@
 #include "Conn9.h"
 #include "Req9.h"
 #include "Fid.h"
+#include "stats.h"
 
 namespace jyq {
     struct Srv9 : public HasAux {
@@ -25,6 +26,10 @@ namespace jyq {
             write,
             wstat;
         std::function<void(Fid*)> freefid;
+        /* how the fid table of each connection is synchronized */
+        Fid::Map::Mode fidMode = Fid::Map::Mode::Locked;
+        /* counters kept when set, see T<ServerStats> */
+        std::shared_ptr<ServerStats> stats;
     };
 } // end namespace jyq
 #endif // end LIBJYQ_SRV9_H__
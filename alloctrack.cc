@@ -0,0 +1,193 @@
+/* C++ Implementation copyright (c)2019 Joshua Scoggins
+ * See LICENSE file for license details.
+ */
+#include <atomic>
+#include <cstdlib>
+#include <iomanip>
+#include <new>
+#include "alloctrack.h"
+#include "stats.h"
+
+
+namespace jyq {
+namespace {
+/* one slot per request type, from TVersion to TWStat */
+constexpr auto Slots = (uint8_t(FType::TWStat) - uint8_t(FType::TVersion)) / 2 + 1;
+constexpr auto Phases = size_t(AllocPhase::Count);
+
+struct Counters {
+    std::atomic<uint64_t> requests { 0 };
+    struct Phase {
+        std::atomic<uint64_t> allocations { 0 };
+        std::atomic<uint64_t> bytes { 0 };
+        std::atomic<uint64_t> frees { 0 };
+    };
+    std::array<Phase, Phases> phases;
+};
+
+std::atomic<bool> enabled { false };
+std::array<Counters, Slots> counters;
+
+Counters*
+slot(FType type) noexcept {
+    auto t = uint8_t(type);
+    if (t < uint8_t(FType::TVersion) || t > uint8_t(FType::RWStat)) {
+        return nullptr;
+    }
+    return &counters[(t - uint8_t(FType::TVersion)) / 2];
+}
+
+#ifdef JYQ_ALLOC_STATS
+/* the innermost scope of the calling thread */
+thread_local AllocScope* current = nullptr;
+#endif
+} // end namespace
+
+const char*
+phaseName(AllocPhase phase) noexcept {
+    switch (phase) {
+        case AllocPhase::Decode: return "decode";
+        case AllocPhase::Dispatch: return "dispatch";
+        case AllocPhase::Handler: return "handler";
+        case AllocPhase::Respond: return "respond";
+        case AllocPhase::Encode: return "encode";
+        default: return "unknown";
+    }
+}
+
+void
+enableAllocationTracking(bool value) noexcept {
+    enabled.store(value, std::memory_order_relaxed);
+}
+
+bool
+allocationTrackingEnabled() noexcept {
+    return enabled.load(std::memory_order_relaxed);
+}
+
+void
+countRequest(FType type) noexcept {
+    if (auto c = slot(type); c && allocationTrackingEnabled()) {
+        c->requests.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+#ifdef JYQ_ALLOC_STATS
+AllocScope::AllocScope(AllocPhase phase, FType type) noexcept : _outer(current), _phase(phase), _type(type) {
+    current = this;
+}
+
+AllocScope::~AllocScope() {
+    current = _outer;
+    if (auto c = slot(_type); c && (_allocations || _frees)) {
+        auto& p = c->phases[size_t(_phase)];
+        p.allocations.fetch_add(_allocations, std::memory_order_relaxed);
+        p.bytes.fetch_add(_bytes, std::memory_order_relaxed);
+        p.frees.fetch_add(_frees, std::memory_order_relaxed);
+    }
+}
+#endif
+
+uint64_t
+AllocationReport::Row::allocations() const noexcept {
+    uint64_t total = 0;
+    for (const auto& p : phases) {
+        total += p.allocations;
+    }
+    return total;
+}
+
+uint64_t
+AllocationReport::Row::bytes() const noexcept {
+    uint64_t total = 0;
+    for (const auto& p : phases) {
+        total += p.bytes;
+    }
+    return total;
+}
+
+AllocationReport
+allocationReport() {
+    AllocationReport out;
+    for (auto i = 0u; i < Slots; ++i) {
+        auto& c = counters[i];
+        AllocationReport::Row row { FType(uint8_t(FType::TVersion) + 2 * i), c.requests.load(std::memory_order_relaxed), { } };
+        for (auto p = 0u; p < Phases; ++p) {
+            row.phases[p] = AllocationReport::Phase {
+                c.phases[p].allocations.load(std::memory_order_relaxed),
+                c.phases[p].bytes.load(std::memory_order_relaxed),
+                c.phases[p].frees.load(std::memory_order_relaxed),
+            };
+        }
+        if (row.requests || row.allocations()) {
+            out.rows.push_back(row);
+        }
+    }
+    return out;
+}
+
+std::ostream&
+operator<<(std::ostream& os, const AllocationReport& report) {
+    auto flags = os.flags();
+    os << std::fixed << std::setprecision(1);
+    for (const auto& row : report.rows) {
+        auto requests = double(row.requests ? row.requests : 1);
+        os << typeName(row.type) << ": " << double(row.allocations()) / requests << " allocations/request, "
+           << double(row.bytes()) / requests << " bytes/request (";
+        for (auto p = 0u; p < Phases; ++p) {
+            os << (p ? ", " : "") << phaseName(AllocPhase(p)) << " " << double(row.phases[p].allocations) / requests;
+        }
+        os << ")" << std::endl;
+    }
+    os.flags(flags);
+    return os;
+}
+
+} // end namespace jyq
+
+#ifdef JYQ_ALLOC_STATS
+/*
+ * The replaceable global allocation functions. The array and nothrow
+ * forms of the standard library forward to these two; the sized
+ * deletes are replaced as well, as the compiler warns when only the
+ * unsized ones are.
+ */
+void*
+operator new(std::size_t size) {
+    if (auto scope = jyq::current; scope && jyq::enabled.load(std::memory_order_relaxed)) {
+        scope->allocated(size);
+    }
+    for (size = size ? size : 1;;) {
+        if (auto ptr = std::malloc(size); ptr) {
+            return ptr;
+        } else if (auto handler = std::get_new_handler(); handler) {
+            handler();
+        } else {
+            throw std::bad_alloc();
+        }
+    }
+}
+
+void
+operator delete(void* ptr) noexcept {
+    if (auto scope = jyq::current; ptr && scope && jyq::enabled.load(std::memory_order_relaxed)) {
+        scope->freed();
+    }
+    std::free(ptr);
+}
+
+void
+operator delete(void* ptr, std::size_t) noexcept {
+    operator delete(ptr);
+}
+
+void
+operator delete[](void* ptr) noexcept {
+    operator delete(ptr);
+}
+
+void
+operator delete[](void* ptr, std::size_t) noexcept {
+    operator delete[](ptr);
+}
+#endif
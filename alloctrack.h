@@ -0,0 +1,111 @@
+#ifndef LIBJYQ_ALLOCTRACK_H__
+#define LIBJYQ_ALLOCTRACK_H__
+/* C++ Implementation copyright (c)2019 Joshua Scoggins
+ * See LICENSE file for license details.
+ */
+
+#include <array>
+#include <ostream>
+#include <vector>
+#include "types.h"
+
+
+namespace jyq {
+    /**
+     * Type: AllocPhase
+     *
+     * The stages of serving a request which heap allocations are
+     * charged to: decoding the T message, dispatching it to its tag
+     * slot, running the handler (including the checks made before the
+     * T<Srv9> callback), building the reply in respond and encoding it.
+     */
+    enum class AllocPhase : uint8_t {
+        Decode,
+        Dispatch,
+        Handler,
+        Respond,
+        Encode,
+        Count,
+    };
+    const char* phaseName(AllocPhase phase) noexcept;
+    /**
+     * Type: AllocScope
+     *
+     * Charges the allocations made by the calling thread while it is
+     * alive to a phase of a request type; the type may be filled in
+     * later with setType, as decoding only learns it at the end. Scopes
+     * nest and only the innermost one is charged.
+     *
+     * Counting needs the library built with JYQ_ALLOC_STATS, which
+     * replaces the global operator new and delete, and enabled at run
+     * time with F<enableAllocationTracking>. Otherwise scopes do
+     * nothing.
+     */
+#ifdef JYQ_ALLOC_STATS
+    class AllocScope {
+        public:
+            explicit AllocScope(AllocPhase phase, FType type = FType::TError) noexcept;
+            ~AllocScope();
+            AllocScope(const AllocScope&) = delete;
+            AllocScope& operator=(const AllocScope&) = delete;
+            void setType(FType type) noexcept { _type = type; }
+            void allocated(size_t bytes) noexcept {
+                ++_allocations;
+                _bytes += bytes;
+            }
+            void freed() noexcept { ++_frees; }
+        private:
+            AllocScope* _outer;
+            AllocPhase _phase;
+            FType _type;
+            uint64_t _allocations = 0;
+            uint64_t _bytes = 0;
+            uint64_t _frees = 0;
+    };
+#else
+    class AllocScope {
+        public:
+            explicit AllocScope(AllocPhase, FType = FType::TError) noexcept { }
+            void setType(FType) noexcept { }
+    };
+#endif
+    /**
+     * Type: AllocationReport
+     *
+     * Allocation counts per request type, one row per type that was
+     * received, with totals for each T<AllocPhase>.
+     */
+    struct AllocationReport {
+        struct Phase {
+            uint64_t allocations;
+            uint64_t bytes;
+            uint64_t frees;
+        };
+        struct Row {
+            FType type;
+            uint64_t requests;
+            std::array<Phase, size_t(AllocPhase::Count)> phases;
+            uint64_t allocations() const noexcept;
+            uint64_t bytes() const noexcept;
+        };
+        std::vector<Row> rows;
+    };
+    /**
+     * Function: enableAllocationTracking
+     * Function: allocationReport
+     * Function: countRequest
+     *
+     * Allocation tracking is off until enabled. countRequest tallies
+     * one request of a type so the report can show averages per
+     * request. The report prints as lines such as
+     * "Twalk: 23.0 allocations/request, 1480 bytes/request", followed
+     * by the split between phases.
+     */
+    void enableAllocationTracking(bool value = true) noexcept;
+    bool allocationTrackingEnabled() noexcept;
+    void countRequest(FType type) noexcept;
+    AllocationReport allocationReport();
+    std::ostream& operator<<(std::ostream& os, const AllocationReport& report);
+} // end namespace jyq
+
+#endif // end LIBJYQ_ALLOCTRACK_H__
@@ -1,11 +1,13 @@
 /* Copyright ©2007-2010 Kris Maglione <maglione.k at Gmail>
  * See LICENSE file for license details.
  */
+#include <algorithm>
 #include <cstdarg>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <limits>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -13,6 +15,7 @@
 #include "CFid.h"
 #include "util.h"
 #include "socket.h"
+#include "timer.h"
 
 namespace jyq {
 constexpr auto RootFid = 1;
@@ -28,6 +31,7 @@ Client::getFid() {
     if (_freefid.empty()) {
         auto ptr = std::make_shared<CFid>();
         ptr->setFid(++_lastfid);
+        ptr->setClient(this);
         return ptr;
     } else {
         std::shared_ptr<CFid> front(_freefid.front()); // make a copy?
@@ -66,25 +70,29 @@ initfid(std::shared_ptr<CFid> f, Fcall *fcall, uint iounit) {
     f->setIoUnit(iounit);
     f->setQid(fcall->getRopen().getQid());
 }
+std::shared_ptr<Stat>
+unpackstat(Fcall& result) {
+    auto& data = result.getRstat().getStat();
+    // the Msg takes ownership of its buffer
+    char* buf = new char[data.size()];
+    memcpy(buf, data.data(), data.size());
+    Msg msg(buf, result.getRstat().size(), Msg::Mode::Unpack);
+    auto stat = std::make_shared<Stat>();
+    msg.pstat(*stat);
+    if(msg.getPos() > msg.getEnd()) {
+        return nullptr;
+    } else {
+        return stat;
+    }
+}
+
 std::shared_ptr<Stat>
 _stat(ulong fid, std::function<std::shared_ptr<Fcall>(Fcall&)> dofcall) {
 	Fcall fcall(FType::TStat, fid);
     if (auto result = dofcall(fcall); !result) {
         return nullptr;
     } else {
-
-        char* buf = new char[result->getRstat().getStat().size()];
-        for (auto i = 0; i < result->getRstat().getStat().size(); ++i) {
-            buf[i] = result->getRstat().getStat()[i];
-        }
-        Msg msg(buf, result->getRstat().size(), Msg::Mode::Unpack);
-        auto stat = std::make_shared<Stat>();
-        msg.pstat(*stat);
-        if(msg.getPos() > msg.getEnd()) {
-            return nullptr;
-        } else {
-            return stat;
-        }
+        return unpackstat(*result);
     }
 }
 
@@ -126,7 +134,7 @@ _pwrite(CFid *f, const void *buf, long count, int64_t offset, DoFcallFunc dofcal
 		n = min<int>(count-len, f->getIoUnit());
         auto& twrite = fcall.getTWrite();
         twrite.setOffset(offset);
-        twrite.setData((char*)buf + len);
+        twrite.setData(std::string((const char*)buf + len, n));
         twrite.setSize(n);
         if (auto result = dofcall(fcall); !result) {
             return -1;
@@ -142,6 +150,268 @@ _pwrite(CFid *f, const void *buf, long count, int64_t offset, DoFcallFunc dofcal
 	} while(len < count);
 	return len;
 }
+
+/* the checks of dofcall, without raising an error */
+std::shared_ptr<Fcall>
+checkreply(FType request, std::shared_ptr<Fcall> reply) {
+    if (!reply || reply->getType() == FType::RError || uint8_t(reply->getType()) != (uint8_t(request) ^ 1)) {
+        return nullptr;
+    }
+    return reply;
+}
+
+/* the error dofcall would raise for reply, or the empty string */
+std::string
+replyerror(FType request, const std::shared_ptr<Fcall>& reply) {
+    if (!reply) {
+        return "connection lost";
+    } else if (reply->getType() == FType::RError) {
+        return reply->getError().getEname();
+    } else if (uint8_t(reply->getType()) != (uint8_t(request) ^ 1)) {
+        return "received mismatched fcall";
+    }
+    return std::string();
+}
+
+/* a Twalk of path from the root, still lacking its newfid */
+Fcall
+walkfcall(const std::string& path) {
+    auto separation = tokenize(path, '/');
+    if (separation.size() > maximum::Welem) {
+        throw Exception("Path: '", path, "' is split into more than ", int(maximum::Welem), " components!");
+    }
+    Fcall fcall(FType::TWalk, RootFid);
+    for (auto& sep : separation) {
+        fcall.getTwalk().addWname(sep);
+    }
+    return fcall;
+}
+
+/* the components of path, as walks name them */
+std::vector<std::string>
+splitpath(const std::string& path) {
+    auto elems = tokenize(path, '/');
+    return std::vector<std::string>(elems.begin(), elems.end());
+}
+
+/* Twalks taking newfid from fid through elems[first, last), at most Welem names each */
+void
+addwalks(std::vector<Fcall>& chain, uint fid, uint newfid, const std::vector<std::string>& elems, size_t first, size_t last) {
+    do {
+        auto& twalk = chain.emplace_back(FType::TWalk, fid).getTwalk();
+        twalk.setNewFid(newfid);
+        for (auto end = std::min<size_t>(first + maximum::Welem, last); first < end; ++first) {
+            twalk.addWname(elems[first]);
+        }
+        fid = newfid;
+    } while (first < last);
+}
+
+/* the directory holding path, as the stat cache names it */
+std::string
+parentpath(const std::string& path) {
+    auto key = StatCache::key(path);
+    auto slash = key.rfind('/');
+    return slash == 0 ? "/" : key.substr(0, slash);
+}
+
+/* replyerror, also failing walks which stopped short of the last element */
+std::string
+walkerror(Fcall& twalk, const std::shared_ptr<Fcall>& reply) {
+    if (auto error = replyerror(FType::TWalk, reply); !error.empty()) {
+        return error;
+    } else if (reply->getRwalk().size() < twalk.getTwalk().size()) {
+        return "File does not exist";
+    }
+    return std::string();
+}
+
+/* raise the error of the first of the first n requests of a chain which failed */
+void
+checkchain(std::vector<Fcall>& chain, const std::vector<std::shared_ptr<Fcall>>& replies, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        auto type = chain[i].getType();
+        if (auto error = type == FType::TWalk ? walkerror(chain[i], replies[i]) : replyerror(type, replies[i]); !error.empty()) {
+            wErrorString(error);
+        }
+    }
+}
+
+/*
+ * An async_pread or async_pwrite. Both cover consecutive chunks of
+ * at most an iounit, with up to window of them outstanding. Whatever
+ * order replies arrive in, the outcome is decided by the first chunk,
+ * in offset order, which failed or came up short.
+ */
+struct Transfer {
+    static constexpr auto NoError = std::numeric_limits<long>::max();
+    Client* client;
+    std::shared_ptr<CFid> fid;
+    FType type;
+    char* buf;        /* where reads land */
+    const char* data; /* what writes send */
+    std::string copy; /* the caller's data, for async_pwrite */
+    long count;
+    int64_t offset;
+    std::function<void(long)> done;
+    Mutex lock;
+    long sent = 0;  /* bytes requested so far */
+    long limit = 0; /* where the data ends: count, or the end of the first short reply */
+    long failed = NoError; /* offset of the first request which failed */
+    std::string error;     /* and its error */
+    size_t inflight = 0;
+    size_t window = 1;
+    size_t maxWindow = 1;
+    size_t acked = 0;
+    bool starting = true;
+    uint64_t minRtt = std::numeric_limits<uint64_t>::max();
+};
+
+std::shared_ptr<Transfer>
+transfer(Client* client, std::shared_ptr<CFid> f, FType type, long count, int64_t offset) {
+    auto t = std::make_shared<Transfer>();
+    t->client = client;
+    t->fid = f;
+    t->type = type;
+    t->count = t->limit = count;
+    t->offset = offset;
+    t->maxWindow = client->getMaxWindow();
+    t->window = std::min(client->getWindow(), t->maxWindow);
+    return t;
+}
+
+/*
+ * With the lock held: adapt the window once per window of replies.
+ * While round trips stay near the fastest seen, the link has spare
+ * bandwidth and the window grows, doubling until the first sign of
+ * queueing and by one after; once they reach twice the fastest,
+ * replies are queueing and it shrinks by a quarter.
+ */
+void
+adapt(Transfer& t, uint64_t rtt) {
+    t.minRtt = std::min(t.minRtt, rtt);
+    if (++t.acked < t.window) {
+        return;
+    }
+    t.acked = 0;
+    if (rtt <= t.minRtt + t.minRtt / 4) {
+        t.window = std::min(t.starting ? 2 * t.window : t.window + 1, t.maxWindow);
+        return;
+    }
+    t.starting = false;
+    if (rtt >= 2 * t.minRtt) {
+        t.window = std::max<size_t>(1, t.window - t.window / 4);
+    }
+}
+
+void transfermore(std::shared_ptr<Transfer> t);
+
+/* the count a reply carries, or -1 if it is not a good reply to a request of n bytes */
+long
+replycount(Transfer& t, const std::shared_ptr<Fcall>& reply, long n) {
+    if (!checkreply(t.type, reply)) {
+        return -1;
+    }
+    auto got = long(t.type == FType::TRead ? reply->getRRead().size() : reply->getRWrite().size());
+    return got <= n ? got : -1;
+}
+
+void
+transferdone(std::shared_ptr<Transfer> t, long off, long n, uint64_t start, std::shared_ptr<Fcall> reply) {
+    auto rtt = nsec() - start;
+    auto got = replycount(*t, reply, n);
+    if (got > 0 && t->type == FType::TRead && !reply->getRRead().getData().empty()) {
+        // read straight into place unless it did not fit; chunks do not overlap, so no lock
+        memcpy(t->buf + off, reply->getRRead().getData().data(), got);
+    }
+    auto finished = false;
+    {
+        std::lock_guard<Mutex> lock(t->lock);
+        --t->inflight;
+        if (got < 0) {
+            if (off < t->failed) {
+                t->failed = off;
+                t->error = replyerror(t->type, reply);
+                if (t->error.empty()) {
+                    t->error = "bad count in reply";
+                }
+            }
+        } else {
+            if (got < n) {
+                t->limit = std::min(t->limit, off + got);
+            }
+            adapt(*t, rtt);
+        }
+        finished = t->inflight == 0 && (t->sent >= t->limit || t->failed != Transfer::NoError);
+    }
+    if (!finished) {
+        transfermore(t);
+        return;
+    }
+    t->client->setLearnedWindow(t->window);
+    /* a failure past the end of a short reply does not count, as nothing before it was missing */
+    if (t->failed >= t->limit) {
+        t->error.clear();
+    }
+    t->done(t->failed < t->limit ? -1 : t->limit);
+}
+
+/*
+ * Fill the window with requests at the following offsets. Nothing
+ * more is sent once a reply failed or came up short, as the data
+ * after it would be discarded or leave a hole in the file.
+ */
+void
+transfermore(std::shared_ptr<Transfer> t) {
+    for (;;) {
+        long off = 0, n = 0;
+        {
+            std::lock_guard<Mutex> lock(t->lock);
+            if (t->inflight >= t->window || t->sent >= t->limit || t->failed != Transfer::NoError) {
+                return;
+            }
+            off = t->sent;
+            n = min<long>(t->limit - off, t->fid->getIoUnit());
+            t->sent += n;
+            ++t->inflight;
+        }
+        Fcall fcall(t->type, t->fid->getFid());
+        const char* payload = nullptr;
+        if (t->type == FType::TRead) {
+            fcall.getTRead().setOffset(t->offset + off);
+            fcall.getTRead().setSize(n);
+        } else {
+            // sent from the data itself, not a copy of it
+            fcall.getTWrite().setOffset(t->offset + off);
+            fcall.getTWrite().setSize(n);
+            payload = t->data + off;
+        }
+        auto start = nsec();
+        auto done = [t, off, n, start](auto reply) { transferdone(t, off, n, start, reply); };
+        if (t->type == FType::TRead) {
+            t->client->asyncread(fcall, t->buf + off, done);
+        } else {
+            t->client->asyncrpc(fcall, done, payload);
+        }
+    }
+}
+
+/*
+ * Runs t from the calling thread, raising the error of its first
+ * failed request as dofcall would.
+ */
+long
+runtransfer(std::shared_ptr<Transfer> t) {
+    std::promise<long> result;
+    auto future = result.get_future();
+    t->done = [&result](long n) { result.set_value(n); };
+    transfermore(t);
+    auto n = t->client->await(future);
+    if (!t->error.empty()) {
+        wErrorString(t->error);
+    }
+    return n;
+}
 } // end namespace
 std::shared_ptr<Fcall>
 Client::dofcall(Fcall& fcall) {
@@ -161,6 +431,79 @@ Client::dofcall(Fcall& fcall) {
 	}
     return ret;
 }
+
+/* only while no rpc is outstanding */
+void
+Client::settags(int min, int max) {
+    _mintag = min;
+    _maxtag = max;
+    wait.reset(max - min);
+}
+
+void
+Client::setCache(size_t budget) {
+    if (!_cache) {
+        _cache = std::make_unique<PageCache>(budget);
+    } else {
+        _cache->setBudget(budget);
+    }
+}
+
+void
+Client::setDiskCache(const std::string& dir, size_t budget, const std::string& server) {
+    if (budget == 0) {
+        _disk.reset();
+    } else {
+        _disk = std::make_unique<DiskCache>(dir, server.empty() ? _address : server, budget);
+    }
+}
+
+void
+Client::invalidateCache(uint64_t path) {
+    if (_cache) {
+        _cache->invalidate(path);
+    }
+    if (_disk) {
+        _disk->invalidate(path);
+    }
+    if (_stats) {
+        _stats->invalidate(path);
+    }
+}
+
+void
+Client::setDirCache(size_t limit) {
+    if (!_dirs) {
+        _dirs = std::make_unique<DirCache>(limit, [this](auto f) { async_clunk(f, [](bool) { }); });
+    } else {
+        _dirs->setLimit(limit);
+    }
+}
+
+void
+Client::setStatCache(uint64_t ttl) {
+    if (!_stats) {
+        _stats = std::make_unique<StatCache>(ttl);
+    } else {
+        _stats->setTtl(ttl);
+    }
+}
+
+void
+Client::setWindow(size_t initial, size_t maximum) noexcept {
+    /* every outstanding request holds a tag */
+    _maxWindow = std::clamp<size_t>(maximum, 1, std::max<size_t>(wait.limit(), 1));
+    _window.store(std::clamp<size_t>(initial, 1, _maxWindow), std::memory_order_relaxed);
+}
+
+uint
+Client::iounit(uint suggested) const noexcept {
+    if (suggested == 0 || suggested > (_msize-24)) {
+        return _msize-24;
+    }
+    return suggested;
+}
+
 std::shared_ptr<CFid>
 Client::walkdir(char *path, const char **rest) {
     // TODO: replace with std::filesystem::path iterator, much better
@@ -185,39 +528,94 @@ Client::walkdir(char *path, const char **rest) {
 }
 std::shared_ptr<CFid>
 Client::walk(const std::string& path) {
-    Fcall fcall(FType::TWalk);
-    if (auto separation = tokenize(path, '/'); separation.size() > maximum::Welem) {
-        throw Exception("Path: '", path, "' is split into more than ", int(maximum::Welem), " components!");
-    } else {
-        int n = separation.size();
-        int count = 0;
-        for (auto& sep : separation) {
-            fcall.getTwalk().getWname()[count] = sep.data();
-            ++count;
-        }
-        auto f = getFid();
-        fcall.setFid(RootFid);
-
-        fcall.getTwalk().setSize(n);
-        fcall.getTwalk().setNewFid(f->getFid());
-        auto resultantFcall = dofcall(fcall);
-        if (resultantFcall == 0) {
-            putfid(f);
-            return nullptr;
-        }
-        if(resultantFcall->getRwalk().size() < n) {
-            wErrorString("File does not exist");
-            if(resultantFcall->getRwalk().empty()) {
-                wErrorString("Protocol botch");
-            }
-            putfid(f);
-            return nullptr;
-        }
-
-        f->setQid(resultantFcall->getRwalk().getWqid()[n-1]); // gross... so gross, this is taken from teh c code...so gross
+    auto result = deferred<WalkResult>([&](auto done) { walkchain(path, true, done); });
+    auto [f, error] = await(result);
+    if (!f) {
+        wErrorString(error);
+    }
+    return f;
+}
 
-        return f;
+/*
+ * Walk a new fid to path, from the deepest directory in the dir cache
+ * when cached is set, with a chain of Twalks sent together. The parent
+ * of path is walked to a fid of its own on the way, for the cache. A
+ * cached directory which fails the first Twalk outright may be gone,
+ * so it is dropped and the walk made again from the root.
+ */
+void
+Client::walkchain(const std::string& path, bool cached, Callback<WalkResult> done) {
+    auto elems = std::make_shared<std::vector<std::string>>(splitpath(path));
+    size_t depth = 0;
+    auto base = _dirs && cached ? _dirs->find(*elems, depth) : nullptr;
+    auto last = elems->size();
+    auto f = getFid();
+    std::shared_ptr<CFid> d;
+    if (_dirs && _dirs->getLimit() > 0 && last > depth + 1) {
+        d = getFid();
+    }
+    std::vector<Fcall> chain;
+    if (d) {
+        addwalks(chain, base ? base->getFid() : RootFid, d->getFid(), *elems, depth, last - 1);
+    }
+    /* the first of the Twalks of f */
+    auto first = chain.size();
+    addwalks(chain, d ? d->getFid() : base ? base->getFid() : RootFid, f->getFid(), *elems, d ? last - 1 : depth, last);
+    std::vector<size_t> sizes;
+    for (auto& fcall : chain) {
+        sizes.push_back(fcall.getTwalk().size());
     }
+    async_fcalls(chain, [this, path, done, elems, depth, base, last, f, d, first, sizes](auto replies) mutable {
+                /*
+                 * dropped here rather than with the completion, which may
+                 * happen under the client lock, as dropping the last hold
+                 * on an evicted directory clunks it
+                 */
+                auto from = std::move(base);
+                std::vector<std::string> errors(replies.size());
+                for (size_t i = 0; i < replies.size(); ++i) {
+                    if (errors[i] = replyerror(FType::TWalk, replies[i]); errors[i].empty() && replies[i]->getRwalk().size() < sizes[i]) {
+                        errors[i] = "File does not exist";
+                    }
+                }
+                /* the first Twalk which failed; a fid exists once its first Twalk succeeded */
+                auto failed = std::find_if(errors.begin(), errors.end(), [](auto& e) { return !e.empty(); }) - errors.begin();
+                if (d && failed >= long(first)) {
+                    d->setQid(replies[first-1]->getRwalk().getWqid()[sizes[first-1]-1]);
+                    if (d->getQid().getType() & uint8_t(QType::DIR)) {
+                        _dirs->put(*elems, last - 1, d);
+                    } else {
+                        async_clunk(d, [](bool) { });
+                    }
+                } else if (d && failed > 0) {
+                    async_clunk(d, [](bool) { });
+                } else if (d) {
+                    putfid(d);
+                }
+                if (failed == long(replies.size())) {
+                    if (sizes.back() > 0) {
+                        f->setQid(replies.back()->getRwalk().getWqid()[sizes.back()-1]);
+                    } else if (from) {
+                        f->setQid(from->getQid());
+                    }
+                    if (_stats && last > 0) {
+                        _stats->revalidate(path, f->getQid());
+                    }
+                    done(WalkResult(f, std::string()));
+                    return;
+                }
+                if (errors[first].empty()) {
+                    async_clunk(f, [](bool) { });
+                } else {
+                    putfid(f);
+                }
+                if (from && failed == 0 && !replyerror(FType::TWalk, replies[0]).empty()) {
+                    _dirs->invalidate(*elems, depth);
+                    walkchain(path, false, done);
+                    return;
+                }
+                done(WalkResult(nullptr, errors[failed]));
+            });
 }
 
 /**
@@ -240,6 +638,15 @@ Client::remove(const char *path) {
         return false;
     } else {
         Fcall fcall(FType::TRemove, f->getFid());
+        invalidateCache(f->getQid().getPath());
+        if (_dirs) {
+            auto elems = splitpath(path);
+            _dirs->invalidate(elems, elems.size());
+        }
+        if (_stats) {
+            _stats->invalidate(path);
+            _stats->invalidate(parentpath(path));
+        }
         auto ret = dofcall(fcall);
         putfid(f);
 
@@ -250,7 +657,12 @@ Client::remove(const char *path) {
 
 Client::~Client() {
     fd.shutdown(SHUT_RDWR);
+    if (_reader.joinable()) {
+        _reader.join();
+    }
     fd.close();
+    // the list head links to itself
+    sleep->clearLinks();
 }
 
 
@@ -286,36 +698,36 @@ Client::mountfd(const Connection& fd) {
     c->allocmsg(256);
 	c->_lastfid = RootFid;
 	/* Override tag matching on TVersion */
-	c->_mintag = NoTag;
-	c->_maxtag = NoTag+1;
+	c->settags(NoTag, NoTag+1);
 
     ver.setSize(maximum::Msg);
     ver.setVersion(Version);
 
-    fcall._storage = ver;
-	if(!c->dofcall(fcall)) {
+    fcall.emplace<FVersion>(ver);
+    auto rversion = c->dofcall(fcall);
+	if(!rversion) {
 		return nullptr;
 	}
 
-    if (fcall.getVersion().getVersion() != Version
-	|| fcall.getVersion().size() > maximum::Msg) {
+    if (rversion->getVersion().getVersion() != Version
+	|| rversion->getVersion().size() > maximum::Msg) {
 		wErrorString("bad 9P version response");
 		return nullptr;
 	}
 
-	c->_mintag = 0;
-	c->_maxtag = 255;
-	c->_msize = fcall.getVersion().size();
+	c->settags(0, NoTag);
+	c->_msize = rversion->getVersion().size();
 
-	c->allocmsg(fcall.getVersion().size());
+	c->allocmsg(c->_msize);
     //fcall.reset();
     FAttach contents;
     contents.setType(FType::TAttach);
     contents.setFid(RootFid);
     contents.setAfid(NoFid);
-	contents.setUname(getenv("USER"));
+    auto user = getenv("USER");
+	contents.setUname(user ? user : "none");
     contents.setAname("");
-    fcall._storage = contents;
+    fcall.emplace<FAttach>(contents);
 	if(!c->dofcall(fcall)) {
 		return nullptr;
 	}
@@ -327,8 +739,11 @@ std::unique_ptr<Client>
 Client::mount(const char *address) {
     if (Connection fd = Connection::dial(address); !fd.isLegal()) {
         return nullptr;
+    } else if (auto c = mountfd(fd); !c) {
+        return c;
     } else {
-        return mountfd(fd);
+        c->_address = address;
+        return c;
     }
 }
 
@@ -388,16 +803,17 @@ Client::create(const char *path, uint perm, uint8_t mode) {
         tcreate.setName(path);
         tcreate.setPerm(perm);
         tcreate.setMode(mode);
+        if (_stats) {
+            // walkdir cut tpath at the end of the parent
+            _stats->invalidate(tpath.c_str());
+            _stats->invalidate(std::string(tpath.c_str()) + "/" + path);
+        }
 
         if(auto result = dofcall(fcall); !result) {
             clunk(f);
             return nullptr;
         } else {
-            auto count = result->getRopen().getIoUnit();
-            if (count == 0 || (result->getRopen().getIoUnit() > (_msize-24))) {
-                count = _msize-24;
-            }
-            initfid(f, result.get(), count);
+            initfid(f, result.get(), iounit(result->getRopen().getIoUnit()));
             f->setMode(mode);
             return f;
         }
@@ -417,12 +833,11 @@ Client::open(const char *path, uint8_t mode) {
             clunk(f);
             return nullptr;
         } else {
-            auto count = result->getRopen().getIoUnit();
-            if (count == 0 || (result->getRopen().getIoUnit() > (_msize-24))) {
-                count = _msize-24;
-            }
-            initfid(f, result.get(), count);
+            initfid(f, result.get(), iounit(result->getRopen().getIoUnit()));
             f->setMode(mode);
+            if (mode & uint8_t(OMode::TRUNC)) {
+                invalidateCache(f->getQid().getPath());
+            }
 
             return f;
         }
@@ -459,7 +874,9 @@ CFid::close(DoFcallFunc fn) {
  *	path: The path of the file to stat.
  *	fid:  An open file descriptor to stat.
  *
- * Stats the file at P<path> or pointed to by P<fid>.
+ * Stats the file at P<path> or pointed to by P<fid>. With a
+ * stat cache set on the client, see F<setStatCache>, stat answers
+ * from it while its entry for P<path> lasts.
  *
  * Returns:
  *	Returns an Stat structure, which must be freed by
@@ -470,18 +887,297 @@ CFid::close(DoFcallFunc fn) {
 
 std::shared_ptr<Stat>
 Client::stat(const char *path) {
+    if (auto stat = _stats ? _stats->get(path) : nullptr; stat) {
+        return stat;
+    }
 	if (auto f = walk(path); !f) {
         return nullptr;
     } else {
 	    auto stat = _stat(f->getFid(), [this](auto& fc) { return dofcall(fc); });
         clunk(f);
+        if (stat && _stats) {
+            _stats->put(path, *stat);
+        }
 	    return stat;
     }
 }
 
 std::shared_ptr<Stat>
 CFid::fstat(DoFcallFunc c) {
-	return _stat(_fid, c);
+	auto stat = _stat(_fid, c);
+    if (stat) {
+        // a newer version lets cached reads see the change
+        _qid = stat->getQid();
+    }
+    return stat;
+}
+
+/**
+ * Function: dofcalls
+ * Function: readFile
+ * Function: writeFile
+ * Function: statMany
+ * Function: readDir
+ *
+ * dofcalls sends P<fcalls> back to back, without waiting for any
+ * reply in between, and returns the replies in the same order. Like
+ * F<asyncrpc> it does not raise server errors, and it leaves nullptr
+ * for the requests which were lost. As the client picks the newfid
+ * of a walk itself, later requests may already use it; this relies
+ * on the server handling the requests of a connection in the order
+ * they arrive, as the servers built with this library do.
+ *
+ * readFile reads the whole file at P<path> with a Twalk, Topen
+ * and Tread sent together, which takes a single round trip when
+ * the file fits in one Tread, as the fid is then clunked without
+ * waiting; the rest of a larger file is read from the same fid
+ * with F<pread>. writeFile truncates the file at P<path> and
+ * writes P<data> to it the same way, as long as P<data> fits in a
+ * few Twrites, and otherwise falls back to F<pwrite>. Paths of more
+ * than Welem components, which take several Twalks, are opened
+ * with F<open> first. It returns the
+ * number of bytes written. Both raise the error of the first
+ * request which failed.
+ *
+ * statMany stats every path in P<paths> with a Twalk, Tstat and
+ * Tclunk each, sending those of up to StatBatch paths at once, and
+ * returns nullptr for the paths which could not be stated. Paths
+ * found in the stat cache, see F<setStatCache>, are not sent, and
+ * paths too deep for a single Twalk are stated with F<stat>.
+ *
+ * readDir returns the entries of the directory at P<path>, read
+ * from it whole, and keeps each in the stat cache under its path, so
+ * that listing a directory and then stating its entries takes no
+ * more requests than the listing.
+ *
+ * See also:
+ *	F<open>, F<stat>, F<asyncrpc>
+ */
+std::vector<std::shared_ptr<Fcall>>
+Client::dofcalls(std::vector<Fcall>& fcalls) {
+    auto result = deferred<std::vector<std::shared_ptr<Fcall>>>([&](auto done) { async_fcalls(fcalls, done); });
+    return await(result);
+}
+
+void
+Client::async_fcalls(std::vector<Fcall>& fcalls, Callback<std::vector<std::shared_ptr<Fcall>>> done) {
+    struct Batch {
+        Mutex lock;
+        std::vector<std::shared_ptr<Fcall>> replies;
+        size_t left;
+        Callback<std::vector<std::shared_ptr<Fcall>>> done;
+    };
+    if (fcalls.empty()) {
+        done({ });
+        return;
+    }
+    auto b = std::make_shared<Batch>();
+    b->replies.resize(fcalls.size());
+    b->left = fcalls.size();
+    b->done = std::move(done);
+    for (size_t i = 0; i < fcalls.size(); ++i) {
+        asyncrpc(fcalls[i], [b, i](auto reply) {
+                    Lock lock(b->lock);
+                    b->replies[i] = reply;
+                    if (--b->left == 0) {
+                        lock.unlock();
+                        b->done(std::move(b->replies));
+                    }
+                });
+    }
+}
+
+std::string
+Client::readFile(const std::string& path) {
+    std::string data;
+    std::shared_ptr<CFid> f;
+    if (splitpath(path).size() <= maximum::Welem) {
+        /* no Tclunk follows the Tread, as the rest, if any, is read from the same fid */
+        std::vector<Fcall> chain;
+        chain.reserve(3);
+        chain.push_back(walkfcall(path));
+        f = getFid();
+        auto requested = iounit(0);
+        chain[0].getTwalk().setNewFid(f->getFid());
+        chain.emplace_back(FType::TOpen, f->getFid());
+        chain[1].getTopen().setMode(uint8_t(OMode::READ));
+        chain.emplace_back(FType::TRead, f->getFid());
+        chain[2].getTRead().setOffset(0);
+        chain[2].getTRead().setSize(requested);
+        auto replies = dofcalls(chain);
+        if (!walkerror(chain[0], replies[0]).empty()) {
+            putfid(f);
+            checkchain(chain, replies, 1);
+        }
+        try {
+            checkchain(chain, replies, 3);
+            auto& rread = replies[2]->getRRead();
+            if (rread.size() > requested) {
+                wErrorString("bad count in reply");
+            }
+            data.assign(rread.getData().data(), rread.size());
+        } catch (...) {
+            clunk(f);
+            throw;
+        }
+        initfid(f, replies[1].get(), iounit(replies[1]->getRopen().getIoUnit()));
+        f->setMode(uint8_t(OMode::READ));
+        /* the server may read less than asked at a time, so only less than its iounit is the end */
+        if (data.size() < f->getIoUnit()) {
+            /* all of it came in the first read, so nothing waits on the Rclunk */
+            async_clunk(f, [](bool) { });
+            return data;
+        }
+    } else if (f = open(path, uint8_t(OMode::READ)); !f) {
+        wErrorString("connection lost");
+    }
+    /* read the rest from where the first read stopped */
+    try {
+        std::vector<char> buf(size_t(f->getIoUnit()) * getMaxWindow());
+        for (;;) {
+            auto n = f->pread(buf.data(), buf.size(), data.size(), getDoFcallLambda());
+            if (n < 0) {
+                wErrorString("connection lost");
+            }
+            data.append(buf.data(), n);
+            if (size_t(n) < buf.size()) {
+                break;
+            }
+        }
+    } catch (...) {
+        clunk(f);
+        throw;
+    }
+    clunk(f);
+    return data;
+}
+
+long
+Client::writeFile(const std::string& path, const std::string& data) {
+    /* how many Twrites may follow the Topen */
+    constexpr auto ChainWrites = 8u;
+    auto chunk = iounit(0);
+    if (data.size() > size_t(chunk) * ChainWrites || splitpath(path).size() > maximum::Welem) {
+        auto f = open(path, uint8_t(OMode::WRITE) | uint8_t(OMode::TRUNC));
+        if (!f) {
+            wErrorString("connection lost");
+        }
+        long n = 0;
+        try {
+            n = f->pwrite(data.data(), data.size(), 0, getDoFcallLambda());
+        } catch (...) {
+            clunk(f);
+            throw;
+        }
+        clunk(f);
+        return n;
+    }
+    std::vector<Fcall> chain;
+    chain.reserve(ChainWrites + 3);
+    chain.push_back(walkfcall(path));
+    auto f = getFid();
+    chain[0].getTwalk().setNewFid(f->getFid());
+    chain.emplace_back(FType::TOpen, f->getFid());
+    chain[1].getTopen().setMode(uint8_t(OMode::WRITE) | uint8_t(OMode::TRUNC));
+    for (size_t off = 0; off < data.size(); off += chunk) {
+        auto n = std::min<size_t>(data.size() - off, chunk);
+        auto& twrite = chain.emplace_back(FType::TWrite, f->getFid()).getTWrite();
+        twrite.setOffset(off);
+        twrite.setData(data.substr(off, n));
+        twrite.setSize(n);
+    }
+    chain.emplace_back(FType::TClunk, f->getFid());
+    auto replies = dofcalls(chain);
+    putfid(f);
+    if (auto n = chain[0].getTwalk().size(); n > 0 && walkerror(chain[0], replies[0]).empty()) {
+        invalidateCache(replies[0]->getRwalk().getWqid()[n-1].getPath());
+    }
+    checkchain(chain, replies, chain.size() - 1);
+    /* the data written ends at the first short write */
+    long written = 0;
+    for (size_t i = 2; i + 1 < chain.size(); ++i) {
+        auto n = long(replies[i]->getRWrite().size());
+        written += std::min<long>(n, chain[i].getTWrite().size());
+        if (n < long(chain[i].getTWrite().size())) {
+            break;
+        }
+    }
+    return written;
+}
+
+std::vector<std::shared_ptr<Stat>>
+Client::statMany(const std::vector<std::string>& paths) {
+    std::vector<std::shared_ptr<Stat>> stats(paths.size());
+    for (size_t first = 0; first < paths.size(); first += StatBatch) {
+        auto last = std::min(first + StatBatch, paths.size());
+        std::vector<Fcall> chain;
+        std::vector<std::shared_ptr<CFid>> fids;
+        std::vector<size_t> index;
+        chain.reserve(3 * (last - first));
+        for (auto i = first; i < last; ++i) {
+            if (stats[i] = _stats ? _stats->get(paths[i]) : nullptr; stats[i]) {
+                continue;
+            }
+            if (splitpath(paths[i]).size() > maximum::Welem) {
+                // its walk takes a chain of its own
+                try {
+                    stats[i] = stat(paths[i]);
+                } catch (Exception&) {
+                }
+                continue;
+            }
+            chain.push_back(walkfcall(paths[i]));
+            auto f = fids.emplace_back(getFid());
+            index.push_back(i);
+            chain.back().getTwalk().setNewFid(f->getFid());
+            chain.emplace_back(FType::TStat, f->getFid());
+            chain.emplace_back(FType::TClunk, f->getFid());
+        }
+        auto replies = dofcalls(chain);
+        for (size_t j = 0; j < index.size(); ++j) {
+            putfid(fids[j]);
+            if (walkerror(chain[3*j], replies[3*j]).empty() && checkreply(FType::TStat, replies[3*j+1])) {
+                stats[index[j]] = unpackstat(*replies[3*j+1]);
+                if (stats[index[j]] && _stats) {
+                    _stats->put(paths[index[j]], *stats[index[j]]);
+                }
+            }
+        }
+    }
+    return stats;
+}
+
+std::vector<std::shared_ptr<Stat>>
+Client::readDir(const std::string& path) {
+    auto f = open(path, OMode::READ);
+    if (!f) {
+        return { };
+    }
+    std::vector<std::shared_ptr<Stat>> stats;
+    long n;
+    for (;;) {
+        auto buf = std::make_unique<char[]>(f->getIoUnit());
+        if (n = f->read(buf.get(), f->getIoUnit(), getDoFcallLambda()); n <= 0) {
+            break;
+        }
+        Msg m(buf.release(), n, Msg::Mode::Unpack);
+        while (m.getPos() < m.getEnd()) {
+            auto stat = std::make_shared<Stat>();
+            m.pstat(*stat);
+            if (m.getPos() > m.getEnd()) {
+                break;
+            }
+            if (_stats) {
+                _stats->put(path + "/" + stat->getName(), *stat);
+            }
+            stats.push_back(std::move(stat));
+        }
+    }
+    clunk(f);
+    if (n < 0) {
+        wErrorString("cannot read directory '", path, "'");
+    }
+    return stats;
 }
 
 
@@ -498,7 +1194,15 @@ CFid::fstat(DoFcallFunc c) {
  * from the file pointed to by P<fid>, into P<buf>. read
  * begins reading at its stored offset, and increments it by
  * the number of bytes read. pread reads beginning at
- * P<offset> and does not alter P<fid>'s stored offset.
+ * P<offset> and does not alter P<fid>'s stored offset. Reads
+ * larger than the fid's iounit keep several Treads outstanding,
+ * as F<async_pread> does.
+ *
+ * With a cache set on the client, see F<setCache> and
+ * F<setDiskCache>, reads are served from it for as long as the fid's
+ * qid version, as returned by the walk and open which made it or by
+ * a later F<fstat>, matches the one the blocks were read at; the
+ * blocks missing are read whole, and stored in both caches.
  *
  * Returns:
  *	These functions return the number of bytes read on
@@ -507,10 +1211,103 @@ CFid::fstat(DoFcallFunc c) {
  *	F<mount>, F<open>, F<write>
  */
 
+/* reads larger than an iounit are pipelined through the fid's client */
+static long
+fetch(CFid* f, char* buf, long count, int64_t offset, DoFcallFunc dofcall) {
+    if (auto c = f->getClient(); c && count > long(f->getIoUnit())) {
+        auto t = transfer(c, f->shared_from_this(), FType::TRead, count, offset);
+        t->buf = buf;
+        return runtransfer(t);
+    }
+    return _pread(f, buf, count, offset, dofcall);
+}
+
+/* a block from memory, or else from disk, which then keeps it in memory too */
+static PageCache::Page
+cachedblock(Client& c, const Qid& qid, uint64_t block) {
+    auto memory = c.getCache();
+    if (auto page = memory ? memory->get(qid, block) : nullptr; page) {
+        return page;
+    }
+    auto disk = c.getDiskCache();
+    auto page = disk ? disk->get(qid, block) : nullptr;
+    if (page && memory) {
+        memory->put(qid, block, *page);
+    }
+    return page;
+}
+
+static bool
+cached(Client& c, const Qid& qid, uint64_t block) {
+    return (c.getCache() && c.getCache()->contains(qid, block)) || (c.getDiskCache() && c.getDiskCache()->contains(qid, block));
+}
+
+/* copy what is cached, and fetch each run of missing blocks at once */
+static long
+cachedread(Client& c, CFid* f, char* buf, long count, int64_t offset, DoFcallFunc dofcall) {
+    constexpr auto BlockSize = int64_t(PageCache::BlockSize);
+    auto qid = f->getQid();
+    auto last = (offset + count - 1) / BlockSize;
+    long len = 0;
+    while (len < count) {
+        auto pos = offset + len;
+        auto block = pos / BlockSize;
+        auto within = size_t(pos % BlockSize);
+        if (auto page = cachedblock(c, qid, block); page) {
+            if (within >= page->size()) {
+                break;
+            }
+            auto n = min<long>(page->size() - within, count - len);
+            memcpy(buf + len, page->data() + within, n);
+            len += n;
+            if (page->size() < size_t(BlockSize)) {
+                break;
+            }
+            continue;
+        }
+        auto end = block + 1;
+        while (end <= last && !cached(c, qid, end)) {
+            ++end;
+        }
+        std::string run((end - block) * BlockSize, '\0');
+        auto got = fetch(f, run.data(), run.size(), block * BlockSize, dofcall);
+        if (got < 0) {
+            return len ? len : -1;
+        }
+        run.resize(got);
+        for (auto b = block; b < end && size_t((b - block) * BlockSize) <= run.size(); ++b) {
+            auto data = run.substr((b - block) * BlockSize, BlockSize);
+            if (auto disk = c.getDiskCache(); disk) {
+                disk->put(qid, b, data);
+            }
+            if (auto memory = c.getCache(); memory) {
+                memory->put(qid, b, std::move(data));
+            }
+        }
+        auto n = within < run.size() ? min<long>(run.size() - within, count - len) : 0;
+        memcpy(buf + len, run.data() + within, n);
+        len += n;
+        if (run.size() < (end - block) * size_t(BlockSize)) {
+            break;
+        }
+    }
+    return len;
+}
+
+static long
+readat(CFid* f, char* buf, long count, int64_t offset, DoFcallFunc dofcall) {
+    auto c = f->getClient();
+    if (c && count > 0 && ((c->getCache() && c->getCache()->getBudget() > 0) || c->getDiskCache())
+            && PageCache::cacheable(f->getQid(), f->getMode())) {
+        return cachedread(*c, f, buf, count, offset, dofcall);
+    }
+    return fetch(f, buf, count, offset, dofcall);
+}
+
 long
 CFid::read(void *buf, long count, DoFcallFunc dofcall) {
     auto theLock = getIoLock();
-	int n = _pread(this, (char*)buf, count, _offset, dofcall);
+	int n = readat(this, (char*)buf, count, _offset, dofcall);
 	if(n > 0) {
 		_offset += n;
     }
@@ -520,7 +1317,7 @@ CFid::read(void *buf, long count, DoFcallFunc dofcall) {
 long
 CFid::pread(void *buf, long count, int64_t offset, DoFcallFunc fn) {
     auto theLock = getIoLock();
-	return _pread(this, (char*)buf, count, offset, fn);
+	return readat(this, (char*)buf, count, offset, fn);
 }
 
 
@@ -537,7 +1334,9 @@ CFid::pread(void *buf, long count, int64_t offset, DoFcallFunc fn) {
  * data stored in P<buf> to the file pointed to by C<fid>.
  * write writes its data at its stored offset, and
  * increments it by P<count>. pwrite writes its data a
- * P<offset> and does not alter C<fid>'s stored offset.
+ * P<offset> and does not alter C<fid>'s stored offset. Writes
+ * larger than the fid's iounit keep several Twrites outstanding,
+ * as F<async_pwrite> does.
  *
  * Returns:
  *	These functions return the number of bytes actually
@@ -547,10 +1346,32 @@ CFid::pread(void *buf, long count, int64_t offset, DoFcallFunc fn) {
  *	F<mount>, F<open>, F<read>
  */
 
+/* likewise for writes, which need not copy buf as it outlives them */
+static long
+writeat(CFid* f, const void* buf, long count, int64_t offset, DoFcallFunc dofcall) {
+    auto c = f->getClient();
+    if (c) {
+        c->invalidateCache(f->getQid().getPath());
+    }
+    long n = 0;
+    if (c && count > long(f->getIoUnit())) {
+        auto t = transfer(c, f->shared_from_this(), FType::TWrite, count, offset);
+        t->data = (const char*)buf;
+        n = runtransfer(t);
+    } else {
+        n = _pwrite(f, buf, count, offset, dofcall);
+    }
+    /* again, in case a read cached the old contents meanwhile */
+    if (c) {
+        c->invalidateCache(f->getQid().getPath());
+    }
+    return n;
+}
+
 long
 CFid::write(const void *buf, long count, DoFcallFunc fn) {
     auto theLock = getIoLock();
-	auto n = _pwrite(this, buf, count, _offset, fn);
+	auto n = writeat(this, buf, count, _offset, fn);
 	if(n > 0) {
 		_offset += n;
     }
@@ -560,7 +1381,7 @@ CFid::write(const void *buf, long count, DoFcallFunc fn) {
 long
 CFid::pwrite(const void *buf, long count, int64_t offset, DoFcallFunc fn) {
     auto theLock = getIoLock();
-	return _pwrite(this, buf, count, offset, fn);
+	return writeat(this, buf, count, offset, fn);
 }
 
 bool
@@ -574,9 +1395,184 @@ CFid::clunk(DoFcallFunc fn) {
     return performClunk(fn);
 }
 
-Client::Client(int _fd) : fd(_fd), sleep(std::make_shared<BareRpc>()) { }
-Client::Client(const Connection& c) : fd(c), sleep(std::make_shared<BareRpc>()) { 
+Client::Client(int _fd) : Client(Connection(_fd)) { }
+Client::Client(const Connection& c) : fd(c), sleep(std::make_shared<BareRpc>()), _poller(std::make_shared<BareRpc>()), _readrpc(std::make_shared<BareRpc>()) { 
     sleep->circularLink(sleep);
 }
-} // end namespace jyq
 
+/**
+ * Function: async_walk
+ * Function: async_open
+ * Function: async_pread
+ * Function: async_pwrite
+ * Function: async_stat
+ * Function: async_clunk
+ *
+ * Asynchronous forms of F<walk>, F<open>, F<pread>, F<pwrite>,
+ * F<stat>, F<fstat> and F<clunk>, built on F<asyncrpc>. Each
+ * returns once its first request is sent, and passes its result to
+ * P<done>, or to the returned future when P<done> is left out, in
+ * the form the blocking call would return it: nullptr, -1 or false
+ * on failure, as server errors are not raised. The results are
+ * delivered from whichever thread reads the reply, see F<poll> and
+ * F<await>. The same calls on a T<CFid> act on that fid through its
+ * client, and fail as above if it has none.
+ *
+ * async_pread fills P<buf>, which must stay valid until the
+ * read completes. async_pwrite copies P<buf> before it returns.
+ *
+ * A pread or pwrite larger than the fid's iounit is split into
+ * iounit sized Treads or Twrites at consecutive offsets, up to a
+ * window of which are outstanding at once, see F<setWindow>; the
+ * data of each Rread is read straight into its place in P<buf>,
+ * see F<asyncread>. The window grows
+ * while round trip times stay within a quarter of the fastest one
+ * seen, doubling per window of replies until they first rise and by
+ * one after, and shrinks by a quarter once they double, as replies
+ * then queue behind each other.
+ *
+ * No more requests are sent after a failed or short reply, and the
+ * ones in flight are waited for. The result is then decided in
+ * offset order, whatever order the replies came in: the count up to
+ * the first short reply, or -1 if a request before it failed. The
+ * blocking F<pread> and F<pwrite> raise the error of that request.
+ * Other operations which need more than one request send them one
+ * after another.
+ */
+void
+Client::async_walk(const std::string& path, Callback<std::shared_ptr<CFid>> done) {
+    walkchain(path, true, [done](auto result) { done(result.first); });
+}
+
+void
+Client::async_open(const std::string& path, uint8_t mode, Callback<std::shared_ptr<CFid>> done) {
+    async_walk(path, [this, mode, done](auto f) {
+                if (!f) {
+                    done(nullptr);
+                    return;
+                }
+                Fcall fcall(FType::TOpen, f->getFid());
+                fcall.getTopen().setMode(mode);
+                asyncrpc(fcall, [this, f, mode, done](auto reply) {
+                            if (reply = checkreply(FType::TOpen, reply); !reply) {
+                                async_clunk(f, [](bool) { });
+                                done(nullptr);
+                                return;
+                            }
+                            initfid(f, reply.get(), iounit(reply->getRopen().getIoUnit()));
+                            f->setMode(mode);
+                            if (mode & uint8_t(OMode::TRUNC)) {
+                                invalidateCache(f->getQid().getPath());
+                            }
+                            done(f);
+                        });
+            });
+}
+
+void
+Client::async_pread(std::shared_ptr<CFid> f, void* buf, long count, int64_t offset, Callback<long> done) {
+    if (count <= 0) {
+        done(0);
+        return;
+    }
+    auto t = transfer(this, f, FType::TRead, count, offset);
+    t->buf = (char*)buf;
+    t->done = done;
+    transfermore(t);
+}
+
+void
+Client::async_pwrite(std::shared_ptr<CFid> f, const void* buf, long count, int64_t offset, Callback<long> done) {
+    if (count <= 0) {
+        done(0);
+        return;
+    }
+    auto t = transfer(this, f, FType::TWrite, count, offset);
+    /* the data is copied up front, so that buf may go away */
+    t->copy.assign((const char*)buf, count);
+    t->data = t->copy.data();
+    t->done = [this, f, done](long n) {
+        invalidateCache(f->getQid().getPath());
+        done(n);
+    };
+    transfermore(t);
+}
+
+void
+Client::async_stat(std::shared_ptr<CFid> f, Callback<std::shared_ptr<Stat>> done) {
+    Fcall fcall(FType::TStat, f->getFid());
+    asyncrpc(fcall, [done](auto reply) {
+                if (reply = checkreply(FType::TStat, reply); !reply) {
+                    done(nullptr);
+                } else {
+                    done(unpackstat(*reply));
+                }
+            });
+}
+
+void
+Client::async_stat(const std::string& path, Callback<std::shared_ptr<Stat>> done) {
+    if (auto stat = _stats ? _stats->get(path) : nullptr; stat) {
+        done(stat);
+        return;
+    }
+    async_walk(path, [this, path, done](auto f) {
+                if (!f) {
+                    done(nullptr);
+                    return;
+                }
+                async_stat(f, [this, f, path, done](auto stat) {
+                            async_clunk(f, [](bool) { });
+                            if (stat && _stats) {
+                                _stats->put(path, *stat);
+                            }
+                            done(stat);
+                        });
+            });
+}
+
+void
+CFid::async_pread(void* buf, long count, int64_t offset, std::function<void(long)> done) {
+    if (!_client) {
+        done(-1);
+    } else {
+        _client->async_pread(shared_from_this(), buf, count, offset, std::move(done));
+    }
+}
+
+void
+CFid::async_pwrite(const void* buf, long count, int64_t offset, std::function<void(long)> done) {
+    if (!_client) {
+        done(-1);
+    } else {
+        _client->async_pwrite(shared_from_this(), buf, count, offset, std::move(done));
+    }
+}
+
+void
+CFid::async_stat(std::function<void(std::shared_ptr<Stat>)> done) {
+    if (!_client) {
+        done(nullptr);
+    } else {
+        _client->async_stat(shared_from_this(), std::move(done));
+    }
+}
+
+void
+CFid::async_clunk(std::function<void(bool)> done) {
+    if (!_client) {
+        done(false);
+    } else {
+        _client->async_clunk(shared_from_this(), std::move(done));
+    }
+}
+
+void
+Client::async_clunk(std::shared_ptr<CFid> f, Callback<bool> done) {
+    Fcall fcall(FType::TClunk, f->getFid());
+    asyncrpc(fcall, [this, f, done](auto reply) {
+                putfid(f);
+                done(bool(checkreply(FType::TClunk, reply)));
+            });
+}
+} // end namespace jyq
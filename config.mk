@@ -7,5 +7,11 @@ GENFLAGS := -Wall -Wextra ${ASMTOOL_EXTRAS}
 #LIBS :=
 OPTIMIZATION_FLAGS := -O0
 DEBUGGING_FLAGS := -g3
-CXXFLAGS := -std=c++17 ${GENFLAGS} ${OPTIMIZATION_FLAGS} ${DEBUGGING_FLAGS}
+# USDT probes for bpftrace/perf, needs sys/sdt.h (systemtap-sdt-dev)
+#PROBE_FLAGS := -DJYQ_USDT
+# lock contention counters, see lockstats.h; users must build with the same flag
+#LOCK_FLAGS := -DJYQ_LOCK_STATS
+# per request allocation counts, replaces the global operator new and delete
+#ALLOC_FLAGS := -DJYQ_ALLOC_STATS
+CXXFLAGS := -std=c++17 ${GENFLAGS} ${OPTIMIZATION_FLAGS} ${DEBUGGING_FLAGS} ${PROBE_FLAGS} ${LOCK_FLAGS} ${ALLOC_FLAGS}
 LDFLAGS := ${LIBS} ${OPTIMIZATION_FLAGS}
@@ -144,6 +144,14 @@ Msg::pdata(std::string& data, uint len) {
 	_pos += len;
 }
 
+void
+Msg::pdata(const std::string& data, uint len) {
+    if((_pos + len) <= _end && !unpackRequested()) {
+        data.copy(_pos, len);
+    }
+	_pos += len;
+}
+
 void
 Msg::pdata(std::vector<uint8_t>& data, uint len) {
     if((_pos + len) <= _end) {
@@ -0,0 +1,132 @@
+/* C++ Implementation copyright (c)2019 Joshua Scoggins
+ * See LICENSE file for license details.
+ */
+#include "dircache.h"
+
+
+namespace jyq {
+struct DirCache::Handle {
+    std::shared_ptr<CFid> fid;
+    std::shared_ptr<Release> release;
+    ~Handle() {
+        if (*release) {
+            (*release)(std::move(fid));
+        }
+    }
+};
+
+DirCache::DirCache(size_t limit, Release release) : _limit(limit), _release(std::make_shared<Release>(std::move(release))) { }
+
+DirCache::~DirCache() {
+    *_release = nullptr;
+}
+
+std::string
+DirCache::key(const std::vector<std::string>& elems, size_t depth) {
+    std::string result;
+    for (size_t i = 0; i < depth; ++i) {
+        result += '/';
+        result += elems[i];
+    }
+    return result;
+}
+
+std::shared_ptr<CFid>
+DirCache::find(const std::vector<std::string>& elems, size_t& depth) {
+    std::vector<std::string> keys(elems.size() + 1);
+    for (size_t i = 0; i < elems.size(); ++i) {
+        keys[i + 1] = keys[i] + '/' + elems[i];
+    }
+    std::lock_guard<Mutex> lock(_lock);
+    for (auto d = elems.size(); d > 0; --d) {
+        if (auto it = _entries.find(keys[d]); it != _entries.end()) {
+            _lru.splice(_lru.begin(), _lru, it->second.lru);
+            _hits.fetch_add(1, std::memory_order_relaxed);
+            depth = d;
+            // shares ownership of the handle, so that the fid outlives an eviction
+            auto& handle = it->second.handle;
+            return std::shared_ptr<CFid>(handle, handle->fid.get());
+        }
+    }
+    _misses.fetch_add(1, std::memory_order_relaxed);
+    depth = 0;
+    return nullptr;
+}
+
+void
+DirCache::put(const std::vector<std::string>& elems, size_t depth, std::shared_ptr<CFid> fid) {
+    auto handle = std::make_shared<Handle>();
+    handle->fid = std::move(fid);
+    handle->release = _release;
+    auto k = key(elems, depth);
+    Dropped dropped;
+    std::lock_guard<Mutex> lock(_lock);
+    if (getLimit() == 0) {
+        return;
+    }
+    if (auto it = _entries.find(k); it != _entries.end()) {
+        erase(it, dropped);
+    }
+    _lru.push_front(k);
+    _entries.emplace(std::move(k), Entry { std::move(handle), _lru.begin() });
+    shrink(dropped);
+}
+
+void
+DirCache::invalidate(const std::vector<std::string>& elems, size_t depth) {
+    auto k = key(elems, depth);
+    Dropped dropped;
+    std::lock_guard<Mutex> lock(_lock);
+    for (auto it = _entries.lower_bound(k); it != _entries.end() && it->first.compare(0, k.size(), k) == 0;) {
+        if (it->first.size() == k.size() || it->first[k.size()] == '/') {
+            erase(it++, dropped);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void
+DirCache::clear() {
+    Dropped dropped;
+    std::lock_guard<Mutex> lock(_lock);
+    for (auto& [k, entry] : _entries) {
+        dropped.push_back(std::move(entry.handle));
+    }
+    _entries.clear();
+    _lru.clear();
+}
+
+void
+DirCache::setLimit(size_t limit) {
+    Dropped dropped;
+    std::lock_guard<Mutex> lock(_lock);
+    _limit.store(limit, std::memory_order_relaxed);
+    shrink(dropped);
+}
+
+DirCache::Stats
+DirCache::stats() {
+    std::lock_guard<Mutex> lock(_lock);
+    return Stats {
+        _hits.load(std::memory_order_relaxed),
+        _misses.load(std::memory_order_relaxed),
+        _entries.size(),
+    };
+}
+
+void
+DirCache::erase(std::map<std::string, Entry>::iterator it, Dropped& dropped) {
+    dropped.push_back(std::move(it->second.handle));
+    _lru.erase(it->second.lru);
+    _entries.erase(it);
+}
+
+void
+DirCache::shrink(Dropped& dropped) {
+    while (_entries.size() > getLimit() && !_lru.empty()) {
+        erase(_entries.find(_lru.back()), dropped);
+    }
+}
+
+} // end namespace jyq
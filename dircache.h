@@ -0,0 +1,90 @@
+#ifndef LIBJYQ_DIRCACHE_H__
+#define LIBJYQ_DIRCACHE_H__
+/* C++ Implementation copyright (c)2019 Joshua Scoggins
+ * See LICENSE file for license details.
+ */
+
+#include <atomic>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "types.h"
+
+
+namespace jyq {
+    struct CFid;
+    /**
+     * Type: DirCache
+     *
+     * Fids a T<Client> keeps walked to directories, keyed by path, so
+     * that walks below them start there instead of at the root. Paths
+     * are given as their components, and an entry for the first depth
+     * components of a path is the directory they name.
+     *
+     * A fid found in the cache stays usable for as long as the caller
+     * holds it, even if it is evicted or invalidated meanwhile; the
+     * release function given to the constructor is called for it once
+     * neither the cache nor any caller holds it, and not at all after
+     * the cache is destroyed. The least recently used fids are evicted
+     * beyond the limit. All members may be called from any thread.
+     *
+     * See also:
+     *	F<setDirCache>, F<walk>
+     */
+    class DirCache {
+        public:
+            using Release = std::function<void(std::shared_ptr<CFid>)>;
+            struct Stats {
+                uint64_t hits;
+                uint64_t misses;
+                size_t entries;
+            };
+        public:
+            DirCache(size_t limit, Release release);
+            ~DirCache();
+            DirCache(const DirCache&) = delete;
+            DirCache& operator=(const DirCache&) = delete;
+            /**
+             * @return the fid of the deepest cached directory among the
+             * first elems.size() components of elems or fewer, with
+             * their number in depth, or nullptr and a depth of 0
+             */
+            std::shared_ptr<CFid> find(const std::vector<std::string>& elems, size_t& depth);
+            void put(const std::vector<std::string>& elems, size_t depth, std::shared_ptr<CFid> fid);
+            /**
+             * Drop the directory named by the first depth components of
+             * elems, and every directory below it.
+             */
+            void invalidate(const std::vector<std::string>& elems, size_t depth);
+            void clear();
+            void setLimit(size_t limit);
+            size_t getLimit() const noexcept { return _limit.load(std::memory_order_relaxed); }
+            Stats stats();
+            static std::string key(const std::vector<std::string>& elems, size_t depth);
+        private:
+            struct Handle;
+            struct Entry {
+                std::shared_ptr<Handle> handle;
+                std::list<std::string>::iterator lru;
+            };
+            /* released once the lock is, as releasing a fid sends a Tclunk */
+            using Dropped = std::vector<std::shared_ptr<Handle>>;
+            /* with the lock held */
+            void erase(std::map<std::string, Entry>::iterator it, Dropped& dropped);
+            void shrink(Dropped& dropped);
+        private:
+            Mutex _lock JYQ_LOCK_NAME("DirCache::_lock");
+            std::atomic<size_t> _limit;
+            /* shared with the handles, and emptied by the destructor */
+            std::shared_ptr<Release> _release;
+            std::map<std::string, Entry> _entries;
+            std::list<std::string> _lru; /* most recently used first */
+            std::atomic<uint64_t> _hits { 0 };
+            std::atomic<uint64_t> _misses { 0 };
+    };
+} // end namespace jyq
+
+#endif // end LIBJYQ_DIRCACHE_H__
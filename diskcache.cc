@@ -0,0 +1,292 @@
+/* C++ Implementation copyright (c)2019 Joshua Scoggins
+ * See LICENSE file for license details.
+ */
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "diskcache.h"
+
+
+namespace jyq {
+namespace {
+constexpr char Magic[8] = { 'j', 'y', 'q', 'c', 'a', 'c', 'h', '1' };
+
+/* FNV-1a, which unlike std::hash is the same in every process */
+uint64_t
+fnv(const void* ptr, size_t n, uint64_t h = 14695981039346656037ull) noexcept {
+    for (auto p = (const unsigned char*)ptr; n > 0; --n, ++p) {
+        h = (h ^ *p) * 1099511628211ull;
+    }
+    return h;
+}
+
+/* the lock other processes sharing the store take as well */
+class StoreLock {
+    public:
+        explicit StoreLock(int fd) : _fd(fd) {
+            while (::flock(_fd, LOCK_EX) < 0 && errno == EINTR) {
+                // retry
+            }
+        }
+        ~StoreLock() { ::flock(_fd, LOCK_UN); }
+        StoreLock(const StoreLock&) = delete;
+        StoreLock& operator=(const StoreLock&) = delete;
+    private:
+        int _fd;
+};
+} // end namespace
+
+struct DiskCache::Header {
+    char magic[8];
+    uint32_t blockSize;
+    uint32_t reserved;
+    uint64_t slots;
+    char pad[40];
+};
+
+struct DiskCache::Slot {
+    /* covered by check */
+    uint64_t server;
+    uint64_t path;
+    uint64_t block;
+    uint32_t version;
+    uint32_t length;
+    uint64_t sum; /* of the data */
+    /* not covered, as hits update it */
+    uint64_t check;
+    uint64_t used; /* the stamp of its last use, 0 if the slot is free */
+    char pad[8];
+    uint64_t expected() const noexcept { return fnv(this, offsetof(Slot, check)); }
+};
+
+DiskCache::DiskCache(const std::string& dir, const std::string& server, size_t budget) : _server(fnv(server.data(), server.size())) {
+    static_assert(sizeof(Header) == 64 && sizeof(Slot) == 64, "store layout changed");
+    constexpr auto Stride = sizeof(Slot) + BlockSize;
+    _slots = budget / Stride;
+    if (_slots == 0) {
+        throw Exception("DiskCache: a budget of ", budget, " bytes does not hold a single block");
+    }
+    if (::mkdir(dir.c_str(), 0755) < 0 && errno != EEXIST) {
+        throw Exception("DiskCache: cannot create ", dir, ": ", strerror(errno));
+    }
+    // a store per layout, as resizing one would pull it from under the processes mapping it
+    auto path = dir + "/store-" + std::to_string(BlockSize) + "-" + std::to_string(_slots);
+    if (_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644); _fd < 0) {
+        throw Exception("DiskCache: cannot open ", path, ": ", strerror(errno));
+    }
+    _size = sizeof(Header) + _slots * Stride;
+    StoreLock lock(_fd);
+    struct stat st;
+    if (::fstat(_fd, &st) < 0) {
+        auto error = errno;
+        ::close(_fd);
+        throw Exception("DiskCache: cannot stat ", path, ": ", strerror(error));
+    }
+    /* only a store just created is sized, under the lock, before anyone maps it */
+    auto fresh = st.st_size == 0;
+    if (fresh && ::ftruncate(_fd, _size) < 0) {
+        auto error = errno;
+        ::close(_fd);
+        throw Exception("DiskCache: cannot size ", path, ": ", strerror(error));
+    }
+    Header header { };
+    if (!fresh && (size_t(st.st_size) != _size
+                || ::pread(_fd, &header, sizeof(header), 0) != ssize_t(sizeof(header))
+                || memcmp(header.magic, Magic, sizeof(Magic)) != 0 || header.blockSize != BlockSize || header.slots != _slots)) {
+        ::close(_fd);
+        throw Exception("DiskCache: ", path, " is not a store of this layout");
+    }
+    if (auto map = ::mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0); map == MAP_FAILED) {
+        auto error = errno;
+        ::close(_fd);
+        throw Exception("DiskCache: cannot map ", path, ": ", strerror(error));
+    } else {
+        _map = (char*)map;
+    }
+    if (fresh) {
+        auto& h = *(Header*)_map;
+        memcpy(h.magic, Magic, sizeof(Magic));
+        h.blockSize = BlockSize;
+        h.slots = _slots;
+    }
+    rebuild();
+}
+
+DiskCache::~DiskCache() {
+    ::munmap(_map, _size);
+    ::close(_fd);
+}
+
+DiskCache::Slot&
+DiskCache::slot(size_t i) noexcept {
+    return *(Slot*)(_map + sizeof(Header) + i * (sizeof(Slot) + BlockSize));
+}
+
+char*
+DiskCache::data(size_t i) noexcept {
+    return (char*)&slot(i) + sizeof(Slot);
+}
+
+/* the slot still holds the block, perhaps at another version */
+bool
+DiskCache::valid(size_t i, const Qid& qid, uint64_t block) noexcept {
+    auto& s = slot(i);
+    return s.used != 0 && s.check == s.expected() && s.server == _server && s.path == qid.getPath() && s.block == block;
+}
+
+void
+DiskCache::rebuild() {
+    std::vector<std::pair<uint64_t, size_t>> used;
+    _where.assign(_slots, _lru.end());
+    for (size_t i = 0; i < _slots; ++i) {
+        auto& s = slot(i);
+        if (s.used == 0 || s.check != s.expected() || s.length > BlockSize) {
+            s.used = 0;
+            _free.push_back(i);
+            continue;
+        }
+        used.emplace_back(s.used, i);
+        _clock = std::max(_clock, s.used);
+    }
+    std::sort(used.begin(), used.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+    for (auto& [stamp, i] : used) {
+        _where[i] = _lru.insert(_lru.end(), i);
+        if (auto& s = slot(i); s.server == _server) {
+            // the most recent copy of a block wins
+            _index.emplace(Key(s.path, s.block), i);
+        }
+    }
+}
+
+void
+DiskCache::release(size_t i) noexcept {
+    auto& s = slot(i);
+    if (auto it = _index.find(Key(s.path, s.block)); it != _index.end() && it->second == i) {
+        _index.erase(it);
+    }
+    s.used = 0;
+    s.check = 0;
+    if (_where[i] != _lru.end()) {
+        _lru.erase(_where[i]);
+        _where[i] = _lru.end();
+        _free.push_back(i);
+    }
+}
+
+void
+DiskCache::touch(size_t i) noexcept {
+    slot(i).used = ++_clock;
+    if (_where[i] != _lru.end()) {
+        _lru.splice(_lru.begin(), _lru, _where[i]);
+    } else {
+        _where[i] = _lru.insert(_lru.begin(), i);
+    }
+}
+
+PageCache::Page
+DiskCache::get(const Qid& qid, uint64_t block) {
+    std::lock_guard<Mutex> guard(_lock);
+    auto it = _index.find(Key(qid.getPath(), block));
+    if (it == _index.end()) {
+        _misses.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    auto i = it->second;
+    StoreLock lock(_fd);
+    if (!valid(i, qid, block)) {
+        // another process reused the slot
+        _index.erase(it);
+        _misses.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    auto& s = slot(i);
+    if (s.version != qid.getVersion() || fnv(data(i), s.length) != s.sum) {
+        release(i);
+        _misses.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    auto page = std::make_shared<const std::string>(data(i), s.length);
+    touch(i);
+    _hits.fetch_add(1, std::memory_order_relaxed);
+    return page;
+}
+
+bool
+DiskCache::contains(const Qid& qid, uint64_t block) {
+    std::lock_guard<Mutex> guard(_lock);
+    auto it = _index.find(Key(qid.getPath(), block));
+    if (it == _index.end()) {
+        return false;
+    }
+    StoreLock lock(_fd);
+    return valid(it->second, qid, block) && slot(it->second).version == qid.getVersion();
+}
+
+void
+DiskCache::put(const Qid& qid, uint64_t block, const std::string& data) {
+    if (data.size() > BlockSize) {
+        return;
+    }
+    std::lock_guard<Mutex> guard(_lock);
+    StoreLock lock(_fd);
+    size_t i;
+    if (auto it = _index.find(Key(qid.getPath(), block)); it != _index.end()) {
+        i = it->second;
+    } else if (!_free.empty()) {
+        i = _free.back();
+        _free.pop_back();
+    } else {
+        i = _lru.back();
+        release(i);
+        _free.pop_back();
+        _evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+    auto& s = slot(i);
+    /* invalidate the header first and write it last, so that a torn slot fails its check */
+    s.used = 0;
+    s.check = 0;
+    memcpy(this->data(i), data.data(), data.size());
+    s.server = _server;
+    s.path = qid.getPath();
+    s.block = block;
+    s.version = qid.getVersion();
+    s.length = data.size();
+    s.sum = fnv(data.data(), data.size());
+    s.check = s.expected();
+    _index[Key(qid.getPath(), block)] = i;
+    touch(i);
+}
+
+void
+DiskCache::invalidate(uint64_t path) {
+    std::lock_guard<Mutex> guard(_lock);
+    StoreLock lock(_fd);
+    for (auto it = _index.lower_bound(Key(path, 0)); it != _index.end() && it->first.first == path;) {
+        auto i = (it++)->second;
+        if (auto& s = slot(i); s.used != 0 && s.check == s.expected() && s.server == _server && s.path == path) {
+            release(i);
+        } else {
+            _index.erase(std::prev(it));
+        }
+    }
+}
+
+DiskCache::Stats
+DiskCache::stats() {
+    std::lock_guard<Mutex> guard(_lock);
+    return Stats {
+        _hits.load(std::memory_order_relaxed),
+        _misses.load(std::memory_order_relaxed),
+        _evictions.load(std::memory_order_relaxed),
+        _slots,
+        _slots - _free.size(),
+    };
+}
+
+} // end namespace jyq
@@ -0,0 +1,101 @@
+#ifndef LIBJYQ_DISKCACHE_H__
+#define LIBJYQ_DISKCACHE_H__
+/* C++ Implementation copyright (c)2019 Joshua Scoggins
+ * See LICENSE file for license details.
+ */
+
+#include <atomic>
+#include <list>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include "types.h"
+#include "pagecache.h"
+#include "qid.h"
+
+
+namespace jyq {
+    /**
+     * Type: DiskCache
+     *
+     * A second tier behind the T<PageCache> of a T<Client>, which
+     * keeps blocks of file contents in a directory so that they
+     * outlive the process. Blocks are keyed by the server, the qid
+     * path of their file and their index, and are validated against
+     * the qid version as in the page cache.
+     *
+     * The directory holds a store file per layout, named after the
+     * block size and the number of slots of one block which fit in
+     * the budget; it is mapped into memory and divided into those
+     * slots. Each slot starts with a header naming its block, a
+     * stamp of its last use and checksums of both; the data is
+     * written before the header, so that a slot torn by a crash fails
+     * its checksum and is treated as empty. Opening the store rebuilds
+     * the index and the least recently used order from the headers.
+     *
+     * Several processes may share a directory: each locks the store
+     * with flock(2) while it reads or changes a slot, and checks the
+     * header of a slot before trusting its own index. Blocks stored
+     * by other processes after the store was opened are only seen
+     * once it is reopened. Processes giving a directory different
+     * budgets use different stores, as a store is never resized.
+     *
+     * See also:
+     *	F<setDiskCache>, T<PageCache>
+     */
+    class DiskCache {
+        public:
+            static constexpr size_t BlockSize = PageCache::BlockSize;
+            struct Stats {
+                uint64_t hits;
+                uint64_t misses;
+                uint64_t evictions;
+                size_t slots;
+                size_t used;
+            };
+        public:
+            /**
+             * Open or create the store in dir, for the blocks of the
+             * server named by server, sized to budget bytes. Raises an
+             * error if the store found is damaged.
+             */
+            DiskCache(const std::string& dir, const std::string& server, size_t budget);
+            ~DiskCache();
+            DiskCache(const DiskCache&) = delete;
+            DiskCache& operator=(const DiskCache&) = delete;
+            PageCache::Page get(const Qid& qid, uint64_t block);
+            bool contains(const Qid& qid, uint64_t block);
+            void put(const Qid& qid, uint64_t block, const std::string& data);
+            void invalidate(uint64_t path);
+            Stats stats();
+        private:
+            struct Header;
+            struct Slot;
+            using Key = std::pair<uint64_t, uint64_t>;
+            Slot& slot(size_t i) noexcept;
+            char* data(size_t i) noexcept;
+            /* with the lock held */
+            bool valid(size_t i, const Qid& qid, uint64_t block) noexcept;
+            void rebuild();
+            void release(size_t i) noexcept;
+            void touch(size_t i) noexcept;
+        private:
+            Mutex _lock JYQ_LOCK_NAME("DiskCache::_lock");
+            int _fd = -1;
+            char* _map = nullptr;
+            size_t _size = 0;
+            size_t _slots = 0;
+            uint64_t _server;
+            uint64_t _clock = 0;
+            std::map<Key, size_t> _index;
+            std::list<size_t> _lru; /* most recently used first */
+            std::vector<std::list<size_t>::iterator> _where;
+            std::vector<size_t> _free;
+            std::atomic<uint64_t> _hits { 0 };
+            std::atomic<uint64_t> _misses { 0 };
+            std::atomic<uint64_t> _evictions { 0 };
+    };
+} // end namespace jyq
+
+#endif // end LIBJYQ_DISKCACHE_H__
@@ -0,0 +1,93 @@
+/* C++ Implementation copyright (c)2019 Joshua Scoggins
+ * See LICENSE file for license details.
+ */
+#include "epoch.h"
+
+
+namespace jyq {
+/* the reader record of the calling thread, handed back when it exits */
+struct ThreadRecord {
+    EpochDomain::Record* record = nullptr;
+    uint32_t depth = 0;
+    ~ThreadRecord() {
+        if (record) {
+            EpochDomain::global().release(*record);
+        }
+    }
+};
+
+static thread_local ThreadRecord self;
+
+EpochDomain&
+EpochDomain::global() {
+    static EpochDomain domain;
+    return domain;
+}
+
+EpochDomain::Record&
+EpochDomain::claim() {
+    for (auto& r : _records) {
+        if (auto expected = false; r.claimed.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) {
+            return r;
+        }
+    }
+    throw Exception("Too many threads are reading epoch protected data!");
+}
+
+void
+EpochDomain::release(Record& r) noexcept {
+    r.epoch.store(Idle, std::memory_order_release);
+    r.claimed.store(false, std::memory_order_release);
+}
+
+/**
+ * Type: EpochDomain::Guard
+ *
+ * Pins the current epoch for the lifetime of the guard. The epoch is
+ * read again after the pin is published; if a writer advanced it in
+ * between, the writer may not have seen the pin, so it is published
+ * again with the newer value.
+ */
+EpochDomain::Guard::Guard(bool active) : _active(active) {
+    if (!_active || self.depth++ > 0) {
+        return;
+    }
+    auto& domain = global();
+    if (!self.record) {
+        self.record = &domain.claim();
+    }
+    for (auto e = domain._epoch.load(std::memory_order_acquire);;) {
+        self.record->epoch.store(e, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (auto now = domain._epoch.load(std::memory_order_acquire); now == e) {
+            break;
+        } else {
+            e = now;
+        }
+    }
+}
+
+EpochDomain::Guard::~Guard() {
+    if (_active && --self.depth == 0) {
+        self.record->epoch.store(Idle, std::memory_order_release);
+    }
+}
+
+uint64_t
+EpochDomain::retire() noexcept {
+    auto stamp = _epoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return stamp;
+}
+
+uint64_t
+EpochDomain::oldestPinned() const noexcept {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto oldest = Idle;
+    for (const auto& r : _records) {
+        oldest = jyq::min(oldest, r.epoch.load(std::memory_order_acquire));
+    }
+    return oldest;
+}
+
+} // end namespace jyq
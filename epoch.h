@@ -0,0 +1,76 @@
+#ifndef LIBJYQ_EPOCH_H__
+#define LIBJYQ_EPOCH_H__
+/* C++ Implementation copyright (c)2019 Joshua Scoggins
+ * See LICENSE file for license details.
+ */
+
+#include <array>
+#include <atomic>
+#include "types.h"
+
+
+namespace jyq {
+    /**
+     * Type: EpochDomain
+     *
+     * Epoch based reclamation for structures which are read without
+     * taking a lock. A reader pins the current epoch for as long as it
+     * may hold pointers into the structure; a writer that unlinks an
+     * object stamps it with the value returned by retire and frees it
+     * once reclaimable reports that every pinned reader has moved on.
+     *
+     * Pinning costs a thread local lookup, two loads, a store and a
+     * fence; readers never perform an atomic read-modify-write, so they
+     * do not bounce a shared cache line between cores. Pins nest.
+     *
+     * Each thread claims one of MaxThreads reader records the first
+     * time it pins and gives it back when it exits.
+     *
+     * See also:
+     *	T<FidTable>
+     */
+    class EpochDomain {
+        public:
+            static constexpr auto MaxThreads = 256u;
+            static constexpr auto Idle = ~uint64_t(0);
+            class Guard {
+                public:
+                    explicit Guard(bool active = true);
+                    ~Guard();
+                    Guard(const Guard&) = delete;
+                    Guard(Guard&&) = delete;
+                    Guard& operator=(const Guard&) = delete;
+                    Guard& operator=(Guard&&) = delete;
+                private:
+                    bool _active;
+            };
+        public:
+            static EpochDomain& global();
+            /**
+             * Advance the global epoch after an object has been unlinked.
+             * @return the stamp to reclaim the object against
+             */
+            uint64_t retire() noexcept;
+            /**
+             * @return true once no reader can still see objects retired with stamp
+             */
+            bool reclaimable(uint64_t stamp) const noexcept { return stamp <= oldestPinned(); }
+            uint64_t oldestPinned() const noexcept;
+            uint64_t current() const noexcept { return _epoch.load(std::memory_order_acquire); }
+        private:
+            struct alignas(64) Record {
+                std::atomic<uint64_t> epoch { Idle };
+                std::atomic<bool> claimed { false };
+            };
+            friend struct ThreadRecord;
+            EpochDomain() = default;
+            Record& claim();
+            void release(Record& r) noexcept;
+        private:
+            alignas(64) std::atomic<uint64_t> _epoch { 1 };
+            std::array<Record, MaxThreads> _records;
+    };
+
+} // end namespace jyq
+
+#endif // end LIBJYQ_EPOCH_H__
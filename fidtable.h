@@ -0,0 +1,365 @@
+#ifndef LIBJYQ_FIDTABLE_H__
+#define LIBJYQ_FIDTABLE_H__
+/* C++ Implementation copyright (c)2019 Joshua Scoggins
+ * See LICENSE file for license details.
+ */
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+#include "types.h"
+#include "epoch.h"
+
+
+namespace jyq {
+    /**
+     * Type: FidHandle
+     *
+     * A stable reference to an entry of a T<FidTable>. The handle
+     * records the generation of the entry at the time it was taken;
+     * once the entry is erased, and even if its slot is reused for
+     * another fid, the handle no longer resolves.
+     */
+    struct FidHandle {
+        uint32_t index = 0;
+        uint32_t generation = 0; /* zero never names a live entry */
+        constexpr bool isValid() const noexcept { return generation != 0; }
+    };
+    /**
+     * Type: FidTableMode
+     *
+     * Locked guards every operation on a T<FidTable> with its reader
+     * writer lock. ReadMostly is meant for servers which dispatch
+     * requests on several threads: lookups take no lock and perform no
+     * atomic read-modify-write, while insertions and removals are
+     * serialized among themselves and defer freeing anything a reader
+     * may still see through T<EpochDomain>.
+     */
+    enum class FidTableMode {
+        Locked,
+        ReadMostly,
+    };
+    /**
+     * Type: FidTable
+     *
+     * Maps the fid numbers chosen by a client to the values describing
+     * them. Entries are stored densely in fixed size pages, so they never
+     * move once constructed and freed slots are reused before new pages
+     * are added. Fid numbers are found through an open-addressed index
+     * with linear probing which is rebuilt as it fills up.
+     *
+     * Buckets of the index are single words which are published with
+     * release stores, and the index and page directory are replaced
+     * rather than resized, so in ReadMostly mode a reader only has to
+     * pin the current epoch. Erased values are destroyed once no pinned
+     * reader remains; as in Locked mode, a pointer returned by get stays
+     * usable until its fid is erased.
+     *
+     * memoryUsage reports the bytes held by the table and
+     * bytesPerEntry that figure divided by the number of live fids.
+     *
+     * See also:
+     *	T<Fid>, T<Conn9>, T<FidHandle>, T<FidTableMode>
+     */
+    template<typename V>
+    class FidTable {
+        public:
+            using Handle = FidHandle;
+            using Mode = FidTableMode;
+            static constexpr auto PageBits = 6u;
+            static constexpr auto PageSize = 1u << PageBits;
+            struct Entry {
+                uint32_t key = 0;
+                std::atomic<uint32_t> generation { 0 };
+                std::optional<V> value;
+            };
+            using Page = std::array<Entry, PageSize>;
+        private:
+            static constexpr uint32_t Empty = 0;
+            static constexpr uint32_t Tombstone = ~0u;
+            /* a bucket holds the key in its upper half and Empty, Tombstone or entry index + 1 in its lower half */
+            using Bucket = std::atomic<uint64_t>;
+            struct Index {
+                explicit Index(size_t count) : mask(count - 1), buckets(new Bucket[count]) {
+                    for (size_t i = 0; i < count; ++i) {
+                        buckets[i].store(Empty, std::memory_order_relaxed);
+                    }
+                }
+                size_t size() const noexcept { return mask + 1; }
+                size_t mask;
+                std::unique_ptr<Bucket[]> buckets;
+            };
+            using Directory = std::vector<Page*>;
+            template<typename T>
+            using RetireList = std::vector<std::pair<uint64_t, T>>;
+            struct ReadSection {
+                std::shared_lock<RWLock> lock;
+                EpochDomain::Guard pin;
+            };
+            static constexpr size_t MinimumBuckets = 16;
+        public:
+            explicit FidTable(Mode mode = Mode::Locked) : _mode(mode), _index(new Index(MinimumBuckets)), _directory(new Directory()) { }
+            ~FidTable() {
+                delete _index.load(std::memory_order_relaxed);
+                delete _directory.load(std::memory_order_relaxed);
+                for (auto& old : _oldIndexes) {
+                    delete old.second;
+                }
+                for (auto& old : _oldDirectories) {
+                    delete old.second;
+                }
+            }
+            FidTable(const FidTable&) = delete;
+            FidTable(FidTable&&) = delete;
+            FidTable& operator=(const FidTable&) = delete;
+            FidTable& operator=(FidTable&&) = delete;
+            constexpr Mode getMode() const noexcept { return _mode; }
+            /**
+             * Construct a value for key in place.
+             * @return the new value and true, or the existing value and false
+             */
+            template<typename ... Args>
+            std::pair<V*, bool> emplace(uint32_t key, Args&& ... args) {
+                auto wlock = getWriteLock();
+                if (auto found = lookup(key); found) {
+                    return std::make_pair(found, false);
+                }
+                auto index = allocateEntry();
+                auto& e = entry(index);
+                e.key = key;
+                e.value.emplace(std::forward<Args>(args)...);
+                insertIndex(key, index);
+                _count.fetch_add(1, std::memory_order_relaxed);
+                return std::make_pair(&e.value.value(), true);
+            }
+            V* get(uint32_t key) {
+                auto section = read();
+                return lookup(key);
+            }
+            V* get(Handle h) {
+                auto section = read();
+                if (!h.isValid() || h.index >= directory().size() * PageSize) {
+                    return nullptr;
+                }
+                if (auto& e = entry(h.index); e.generation.load(std::memory_order_acquire) == h.generation) {
+                    return &e.value.value();
+                }
+                return nullptr;
+            }
+            Handle handle(uint32_t key) {
+                auto section = read();
+                if (auto bucket = findBucket(key); bucket) {
+                    auto index = slotOf(bucket->load(std::memory_order_acquire)) - 1;
+                    return Handle { index, entry(index).generation.load(std::memory_order_acquire) };
+                }
+                return Handle { };
+            }
+            /**
+             * Remove the value for key. The value is destroyed outside of
+             * the table lock, in its original location, so that destructor
+             * callbacks may use the table. In ReadMostly mode values
+             * erased while readers were pinned are destroyed by a later
+             * erase or reclaim.
+             */
+            bool erase(uint32_t key) {
+                std::vector<uint32_t> ready;
+                {
+                    auto wlock = getWriteLock();
+                    auto bucket = findBucket(key);
+                    if (!bucket) {
+                        return false;
+                    }
+                    auto index = slotOf(bucket->load(std::memory_order_relaxed)) - 1;
+                    bucket->store(pack(key, Tombstone), std::memory_order_release);
+                    ++_tombstones;
+                    _count.fetch_sub(1, std::memory_order_relaxed);
+                    // stale handles stop resolving from here on
+                    auto& victim = entry(index);
+                    if (auto next = victim.generation.load(std::memory_order_relaxed) + 1; next != 0) {
+                        victim.generation.store(next, std::memory_order_release);
+                    } else {
+                        victim.generation.store(1, std::memory_order_release);
+                    }
+                    _retired.emplace_back(stamp(), index);
+                    collect(ready);
+                }
+                destroy(ready);
+                return true;
+            }
+            /**
+             * Destroy the values erased in ReadMostly mode that no reader
+             * can still see.
+             */
+            void reclaim() {
+                std::vector<uint32_t> ready;
+                {
+                    auto wlock = getWriteLock();
+                    collect(ready);
+                }
+                destroy(ready);
+            }
+            size_t size() const noexcept { return _count.load(std::memory_order_relaxed); }
+            bool empty() const noexcept { return size() == 0; }
+            size_t memoryUsage() const noexcept {
+                return sizeof(*this)
+                    + _index.load(std::memory_order_acquire)->size() * sizeof(Bucket)
+                    + _directory.load(std::memory_order_acquire)->capacity() * sizeof(Page*)
+                    + _pages.capacity() * sizeof(typename decltype(_pages)::value_type)
+                    + _pages.size() * sizeof(Page)
+                    + _free.capacity() * sizeof(uint32_t);
+            }
+            double bytesPerEntry() const noexcept {
+                return double(memoryUsage()) / double(std::max<size_t>(size(), 1));
+            }
+            template<typename T>
+            void exec(std::function<void(T, V&)> fn, T context) {
+                auto section = read();
+                auto& index = *_index.load(std::memory_order_acquire);
+                for (size_t i = 0; i < index.size(); ++i) {
+                    if (auto slot = slotOf(index.buckets[i].load(std::memory_order_acquire)); slot != Empty && slot != Tombstone) {
+                        fn(context, entry(slot - 1).value.value());
+                    }
+                }
+            }
+        private:
+            static size_t hash(uint32_t key) noexcept {
+                // fibonacci hashing spreads the small, dense fid numbers clients pick
+                return size_t(key) * 0x9E3779B97F4A7C15ull;
+            }
+            static constexpr uint64_t pack(uint32_t key, uint32_t slot) noexcept { return (uint64_t(key) << 32) | slot; }
+            static constexpr uint32_t keyOf(uint64_t bucket) noexcept { return uint32_t(bucket >> 32); }
+            static constexpr uint32_t slotOf(uint64_t bucket) noexcept { return uint32_t(bucket); }
+            ReadSection read() {
+                if (_mode == Mode::ReadMostly) {
+                    return ReadSection { std::shared_lock<RWLock>(_lock, std::defer_lock), EpochDomain::Guard(true) };
+                }
+                return ReadSection { std::shared_lock<RWLock>(_lock), EpochDomain::Guard(false) };
+            }
+            uint64_t stamp() noexcept {
+                return _mode == Mode::ReadMostly ? EpochDomain::global().retire() : 0;
+            }
+            const Directory& directory() const noexcept { return *_directory.load(std::memory_order_acquire); }
+            Entry& entry(uint32_t index) noexcept {
+                return (*directory()[index >> PageBits])[index & (PageSize - 1)];
+            }
+            Bucket* findBucket(uint32_t key) noexcept {
+                auto& index = *_index.load(std::memory_order_acquire);
+                for (auto i = (hash(key) >> 32) & index.mask;; i = (i + 1) & index.mask) {
+                    auto& b = index.buckets[i];
+                    if (auto value = b.load(std::memory_order_acquire); slotOf(value) == Empty) {
+                        return nullptr;
+                    } else if (slotOf(value) != Tombstone && keyOf(value) == key) {
+                        return &b;
+                    }
+                }
+            }
+            V* lookup(uint32_t key) noexcept {
+                if (auto bucket = findBucket(key); bucket) {
+                    return &entry(slotOf(bucket->load(std::memory_order_acquire)) - 1).value.value();
+                }
+                return nullptr;
+            }
+            uint32_t allocateEntry() {
+                if (!_free.empty()) {
+                    auto index = _free.back();
+                    _free.pop_back();
+                    return index;
+                }
+                if (auto& current = directory(); _next == current.size() * PageSize) {
+                    _pages.emplace_back(std::make_unique<Page>());
+                    auto grown = new Directory(current);
+                    grown->push_back(_pages.back().get());
+                    _oldDirectories.emplace_back(stamp(), _directory.exchange(grown, std::memory_order_acq_rel));
+                }
+                auto index = _next++;
+                entry(index).generation.store(1, std::memory_order_release);
+                return index;
+            }
+            void insertIndex(uint32_t key, uint32_t index) {
+                // keep the load, tombstones included, under three quarters
+                if (auto buckets = _index.load(std::memory_order_relaxed)->size(); (size() + _tombstones + 1) * 4 > buckets * 3) {
+                    // grow when live entries fill half the index, otherwise just sweep tombstones
+                    rehash((size() + 1) * 2 > buckets ? buckets * 2 : buckets);
+                }
+                auto& current = *_index.load(std::memory_order_relaxed);
+                for (auto i = (hash(key) >> 32) & current.mask;; i = (i + 1) & current.mask) {
+                    if (auto slot = slotOf(current.buckets[i].load(std::memory_order_relaxed)); slot == Empty || slot == Tombstone) {
+                        if (slot == Tombstone) {
+                            --_tombstones;
+                        }
+                        // publishes the entry constructed before the call
+                        current.buckets[i].store(pack(key, index + 1), std::memory_order_release);
+                        return;
+                    }
+                }
+            }
+            void rehash(size_t buckets) {
+                auto fresh = std::make_unique<Index>(buckets);
+                auto& old = *_index.load(std::memory_order_relaxed);
+                for (size_t j = 0; j < old.size(); ++j) {
+                    if (auto value = old.buckets[j].load(std::memory_order_relaxed); slotOf(value) != Empty && slotOf(value) != Tombstone) {
+                        auto i = (hash(keyOf(value)) >> 32) & fresh->mask;
+                        while (slotOf(fresh->buckets[i].load(std::memory_order_relaxed)) != Empty) {
+                            i = (i + 1) & fresh->mask;
+                        }
+                        fresh->buckets[i].store(value, std::memory_order_relaxed);
+                    }
+                }
+                _tombstones = 0;
+                _oldIndexes.emplace_back(stamp(), _index.exchange(fresh.release(), std::memory_order_acq_rel));
+            }
+            /**
+             * Move the erased entries no reader can see into ready and
+             * free the indexes and directories that were replaced.
+             */
+            void collect(std::vector<uint32_t>& ready) {
+                auto oldest = _mode == Mode::ReadMostly ? EpochDomain::global().oldestPinned() : EpochDomain::Idle;
+                auto sweep = [oldest](auto& list, auto fn) {
+                    auto kept = std::remove_if(list.begin(), list.end(), [oldest, &fn](auto& item) {
+                                if (item.first <= oldest) {
+                                    fn(item.second);
+                                    return true;
+                                }
+                                return false;
+                            });
+                    list.erase(kept, list.end());
+                };
+                sweep(_retired, [&ready](uint32_t index) { ready.push_back(index); });
+                sweep(_oldIndexes, [](Index* value) { delete value; });
+                sweep(_oldDirectories, [](Directory* value) { delete value; });
+            }
+            void destroy(const std::vector<uint32_t>& ready) {
+                if (ready.empty()) {
+                    return;
+                }
+                for (auto index : ready) {
+                    entry(index).value.reset();
+                }
+                auto wlock = getWriteLock();
+                _free.insert(_free.end(), ready.begin(), ready.end());
+            }
+            std::unique_lock<RWLock> getWriteLock() { return std::unique_lock<RWLock>(_lock); }
+        private:
+            Mode _mode;
+            std::atomic<Index*> _index;
+            std::atomic<Directory*> _directory;
+            std::vector<std::unique_ptr<Page>> _pages;
+            std::vector<uint32_t> _free;
+            RetireList<uint32_t> _retired;
+            RetireList<Index*> _oldIndexes;
+            RetireList<Directory*> _oldDirectories;
+            uint32_t _next = 0;
+            /* written under the lock, read without it by statistics */
+            std::atomic<size_t> _count { 0 };
+            size_t _tombstones = 0;
+            mutable RWLock _lock JYQ_LOCK_NAME("FidTable::_lock");
+    };
+
+} // end namespace jyq
+
+#endif // end LIBJYQ_FIDTABLE_H__
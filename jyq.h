@@ -5,6 +5,7 @@
  * See LICENSE file for license details.
  */
 #include "types.h"
+#include "alloctrack.h"
 #include "Srv9.h"
 #include "Req9.h"
 #include "util.h"
@@ -12,14 +13,26 @@
 #include "CFid.h"
 #include "Conn.h"
 #include "Conn9.h"
+#include "dircache.h"
+#include "diskcache.h"
+#include "epoch.h"
 #include "Fcall.h"
 #include "Fid.h"
+#include "lockstats.h"
+#include "fidtable.h"
 #include "Msg.h"
 #include "map.h"
+#include "pagecache.h"
 #include "Rpc.h"
 #include "Server.h"
 #include "qid.h"
 #include "socket.h"
 #include "stat.h"
+#include "statcache.h"
+#include "stats.h"
+#include "tagpool.h"
+#include "tagtable.h"
 #include "timer.h"
+#include "trace.h"
+#include "watchdog.h"
 #endif
@@ -1,31 +1,71 @@
 #ifndef LIBJYQ_SRVUTIL_H__
 #define LIBJYQ_SRVUTIL_H__
 
+#include <deque>
 #include <functional>
 #include <list>
 #include <string>
+#include <vector>
 #include "jyq.h"
 namespace jyq {
 struct Pending;
-using Queue = std::list<std::string>;
 using FileIdU = void*;
 
+/* one broadcast event; immutable once written and shared by every subscriber */
+using PendingEvent = std::shared_ptr<const std::string>;
+
+/**
+ * Type: LagPolicy
+ * Type: PendingLimits
+ *
+ * What happens to a subscriber of a T<Pending> which has more unread
+ * events than its P<limits> allow, or which holds back the oldest
+ * event when the whole log is over P<logLimits>. DropOldest skips it
+ * past its oldest unread events. Coalesce does the same, and its next
+ * read returns "N events dropped" before the events which follow.
+ * HangUp fails its outstanding and future reads until the fid is
+ * clunked.
+ *
+ * A limit of 0 is no limit, and none is set by default. The byte
+ * limits never drop the newest event.
+ */
+enum class LagPolicy {
+    DropOldest,
+    Coalesce,
+    HangUp,
+};
+struct PendingLimits {
+    size_t  entries;
+    size_t  bytes;
+};
+
+/**
+ * Type: PendingStats
+ *
+ * Counters of a T<Pending>: events skipped by lagging subscribers,
+ * "events dropped" notices read, subscribers hung up, and the size
+ * of the log.
+ */
+struct PendingStats {
+    uint64_t    dropped;
+    uint64_t    coalesced;
+    uint64_t    hangups;
+    size_t      subscribers;
+    size_t      entries;
+    size_t      bytes;
+};
 
 struct PendingLinkBody {
 	/* Private members */
 	Fid*		fid;
-    Queue queue;
 	Pending*	pending;
+    uint64_t    cursor; /* sequence number of the next event to read */
+    size_t      offset; /* bytes of that event already read */
+    uint64_t    dropped;
+    uint64_t    missed; /* dropped since the last notice, under Coalesce */
+    bool        hungup;
+    std::list<Req9*> reads;
 };
-using RawPendingLink = DoubleLinkedListNode<PendingLinkBody>;
-using PendingLink = std::shared_ptr<RawPendingLink>;
-
-struct RequestLinkBody {
-	/* Private members */
-	Req9*	req;
-};
-using RawRequestLink = DoubleLinkedListNode<RequestLinkBody>;
-using RequestLink = std::shared_ptr<RawRequestLink>;
 
 struct Pending {
     void	pushfid(Fid*);
@@ -34,19 +74,32 @@ struct Pending {
     template<typename ... Args>
     void print(Args&& ... values) {
         std::stringstream str;
-        jyq::print(str, std::forward(values)...);
+        jyq::print(str, std::forward<Args>(values)...);
         auto result = str.str();
         write(result);
     }
     template<typename ... Args>
     void vprint(Args&& ... values) {
         std::stringstream str;
-        jyq::print(str, std::forward(values)...);
+        jyq::print(str, std::forward<Args>(values)...);
         auto result = str.str();
         write(result);
     }
-    RequestLink	req;
-    PendingLink	fids;
+    PendingStats stats();
+    PendingLimits   limits { 0, 0 };
+    PendingLimits   logLimits { 0, 0 };
+    LagPolicy   policy = LagPolicy::DropOldest;
+    /* Private members */
+    struct Entry {
+        PendingEvent event;
+        uint64_t end; /* bytes written up to and including this event */
+    };
+    Mutex       lock JYQ_LOCK_NAME("Pending::lock");
+    std::deque<Entry> log;
+    uint64_t    base = 0; /* sequence number of log.front() */
+    uint64_t    written = 0; /* bytes written so far */
+    PendingStats counters { };
+    std::list<PendingLinkBody> fids;
 };
 
 struct Dirtab {
@@ -57,6 +110,23 @@ struct Dirtab {
 	uint	flags;
 };
 
+/**
+ * Type: DirSnapshot
+ *
+ * The listing of a directory as of the first read of a fid, kept
+ * by F<srv_readdir> so that later reads resume at their offset
+ * instead of listing and stating the directory again. P<data>
+ * holds the packed stat of every entry, back to back, and
+ * P<offsets> where each one starts, followed by the size of
+ * P<data>. P<next> is the entry the previous read stopped at.
+ */
+struct DirSnapshot {
+    uint32_t    version;
+    std::string data;
+    std::vector<uint64_t> offsets;
+    size_t      next = 0;
+};
+
 struct FileIdBody {
 	void* p; // this needs to be here for a special purpose
 	bool		pending;
@@ -65,6 +135,7 @@ struct FileIdBody {
 	Dirtab      tab;
 	uint		nref;
 	bool		_volatile;
+    std::shared_ptr<DirSnapshot> dir;
 };
 using RawFileId = SingleLinkedListNode<FileIdBody>;
 using FileId = std::shared_ptr<RawFileId>;
@@ -228,34 +228,11 @@ xls() {
 	}
     //jyq::Stat::free(stat.get());
 
-    auto fid = client->open(file, jyq::OMode::READ);
-	if(!fid) {
-        throw jyq::Exception("Can't open file '", file, "'");
-    }
-
-    std::vector<std::shared_ptr<jyq::Stat>> stats;
-    // TODO fix this nonsense
-    auto buf = std::make_unique<char[]>(fid->getIoUnit());
-    int count = 0;
-    for (count = fid->read(buf.get(), fid->getIoUnit(), client->getDoFcallLambda()); count > 0; count = fid->read(buf.get(), fid->getIoUnit(), client->getDoFcallLambda())) {
-        auto bufCopy = buf.release();
-        buf.reset(new char[fid->getIoUnit()]);
-        jyq::Msg m(bufCopy, count, jyq::Msg::Mode::Unpack);
-		while(m.getPos() < m.getEnd()) {
-            stats.emplace_back(std::make_shared<jyq::Stat>());
-            m.pstat(stats.back().get());
-		}
-	}
     // TODO implement sorting in the future
-    for (auto& stat : stats) {
+    for (auto& stat : client->readDir(file)) {
         printStat(stat, longView);
-        //jyq::Stat::free(stat.get());
-    }
-	if(count == -1) {
-        throw jyq::Exception("Can't read directory '", file, "'");
-    } else {
-	    return 0;
     }
+    return 0;
 }
 
 std::map<std::string, ServiceFunction> etab = {
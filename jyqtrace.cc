@@ -0,0 +1,58 @@
+/* C++ Implementation copyright (c)2019 Joshua Scoggins
+ * See LICENSE file for license details.
+ */
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <boost/program_options.hpp>
+#include "jyq.h"
+
+namespace Options = boost::program_options;
+
+/*
+ * Converts a binary trace written by jyq::Tracer::save into Chrome
+ * trace JSON, for chrome://tracing or Perfetto.
+ */
+int
+main(int argc, char *argv[]) {
+    try {
+        std::string input;
+        std::string output;
+        Options::options_description genericOptions("Options");
+        Options::positional_options_description positionalActions;
+        positionalActions.add("input", 1);
+        genericOptions.add_options()
+            ("help,h", "Display this help message")
+            ("version,v", "Display the version")
+            ("output,o", Options::value<std::string>(&output), "Write the JSON to this file instead of standard output")
+            ("input", Options::value<std::string>(&input), "The binary trace to convert");
+        Options::variables_map vm;
+        Options::store(Options::command_line_parser(argc, argv).
+                options(genericOptions).positional(positionalActions).run(), vm);
+        Options::notify(vm);
+        if (vm.count("version")) {
+            jyq::print(std::cout, argv[0], "-", VERSION, ", ", COPYRIGHT, "\n");
+            return 0;
+        }
+        if (vm.count("help") || input.empty()) {
+            jyq::print(std::cerr, "usage: ", argv[0], " [-o output.json] trace\n", genericOptions);
+            return vm.count("help") ? 0 : 1;
+        }
+        std::ifstream in(input, std::ios::binary);
+        if (!in) {
+            throw jyq::Exception("Can't open ", input);
+        }
+        auto records = jyq::Tracer::load(in);
+        if (output.empty()) {
+            jyq::writeChromeTrace(std::cout, records);
+        } else if (std::ofstream out(output); out) {
+            jyq::writeChromeTrace(out, records);
+        } else {
+            throw jyq::Exception("Can't open ", output);
+        }
+    } catch (const std::exception& e) {
+        jyq::print(std::cerr, argv[0], ": ", e.what(), "\n");
+        return 1;
+    }
+    return 0;
+}
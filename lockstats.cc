@@ -0,0 +1,175 @@
+/* C++ Implementation copyright (c)2019 Joshua Scoggins
+ * See LICENSE file for license details.
+ */
+#include <algorithm>
+#include <iomanip>
+#include <list>
+#include <map>
+#include "lockstats.h"
+#include "timer.h"
+
+
+namespace jyq {
+namespace {
+/* sites are never freed, so counters survive the locks using them */
+struct Registry {
+    std::mutex lock;
+    std::list<LockSite> sites;
+    std::map<std::string, LockSite*> byName;
+};
+
+Registry&
+registry() {
+    static Registry r;
+    return r;
+}
+
+void
+raise(std::atomic<uint64_t>& value, uint64_t candidate) noexcept {
+    for (auto current = value.load(std::memory_order_relaxed);
+            current < candidate && !value.compare_exchange_weak(current, candidate, std::memory_order_relaxed);) {
+        // retry until candidate is stored or somebody stored a larger value
+    }
+}
+
+/* acquire through try_lock first, so that only contended acquisitions pay for timing the wait */
+template<typename T, typename TryLock, typename Lock>
+void
+acquire(LockSite& site, T& lock, TryLock tryLock, Lock doLock) {
+    site.acquisitions.fetch_add(1, std::memory_order_relaxed);
+    if ((lock.*tryLock)()) {
+        return;
+    }
+    auto start = nsec();
+    (lock.*doLock)();
+    auto waited = nsec() - start;
+    site.contended.fetch_add(1, std::memory_order_relaxed);
+    site.waitTime.fetch_add(waited, std::memory_order_relaxed);
+    raise(site.maxWait, waited);
+}
+
+void
+release(LockSite& site, uint64_t acquired) noexcept {
+    auto held = nsec() - acquired;
+    site.holdTime.fetch_add(held, std::memory_order_relaxed);
+    raise(site.maxHold, held);
+}
+} // end namespace
+
+LockSite&
+lockSite(const char* name, const char* file, int line) {
+    auto key = name ? std::string(name) : std::string(file) + ":" + std::to_string(line);
+    auto& r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    if (auto found = r.byName.find(key); found != r.byName.end()) {
+        return *found->second;
+    }
+    auto& site = r.sites.emplace_back(key);
+    r.byName.emplace(key, &site);
+    return site;
+}
+
+std::vector<LockReport>
+lockReport() {
+    std::vector<LockReport> out;
+    {
+        auto& r = registry();
+        std::lock_guard<std::mutex> guard(r.lock);
+        for (const auto& s : r.sites) {
+            out.push_back(LockReport {
+                        s.name,
+                        s.acquisitions.load(std::memory_order_relaxed),
+                        s.contended.load(std::memory_order_relaxed),
+                        s.waitTime.load(std::memory_order_relaxed),
+                        s.maxWait.load(std::memory_order_relaxed),
+                        s.holdTime.load(std::memory_order_relaxed),
+                        s.maxHold.load(std::memory_order_relaxed),
+                    });
+        }
+    }
+    std::sort(out.begin(), out.end(), [](const auto& a, const auto& b) {
+                return a.waitTime != b.waitTime ? a.waitTime > b.waitTime : a.contended > b.contended;
+            });
+    return out;
+}
+
+void
+printLockReport(std::ostream& os, size_t count) {
+    os << std::left << std::setw(24) << "lock"
+       << std::right << std::setw(12) << "acquired"
+       << std::setw(12) << "contended"
+       << std::setw(12) << "wait-us"
+       << std::setw(12) << "max-wait"
+       << std::setw(12) << "hold-us"
+       << std::setw(12) << "max-hold" << std::endl;
+    auto report = lockReport();
+    for (auto it = report.begin(); it != report.end() && count > 0; ++it, --count) {
+        os << std::left << std::setw(24) << it->name
+           << std::right << std::setw(12) << it->acquisitions
+           << std::setw(12) << it->contended
+           << std::setw(12) << it->waitTime / 1000
+           << std::setw(12) << it->maxWait / 1000
+           << std::setw(12) << it->holdTime / 1000
+           << std::setw(12) << it->maxHold / 1000 << std::endl;
+    }
+}
+
+void
+InstrumentedMutex::lock() {
+    acquire(_site, _lock, &std::mutex::try_lock, &std::mutex::lock);
+    _acquired = nsec();
+}
+
+bool
+InstrumentedMutex::try_lock() {
+    if (!_lock.try_lock()) {
+        return false;
+    }
+    _site.acquisitions.fetch_add(1, std::memory_order_relaxed);
+    _acquired = nsec();
+    return true;
+}
+
+void
+InstrumentedMutex::unlock() {
+    release(_site, _acquired);
+    _lock.unlock();
+}
+
+void
+InstrumentedRWLock::lock() {
+    acquire(_site, _lock, &std::shared_mutex::try_lock, &std::shared_mutex::lock);
+    _acquired = nsec();
+}
+
+bool
+InstrumentedRWLock::try_lock() {
+    if (!_lock.try_lock()) {
+        return false;
+    }
+    _site.acquisitions.fetch_add(1, std::memory_order_relaxed);
+    _acquired = nsec();
+    return true;
+}
+
+void
+InstrumentedRWLock::unlock() {
+    release(_site, _acquired);
+    _lock.unlock();
+}
+
+void
+InstrumentedRWLock::lock_shared() {
+    acquire(_site, _lock, &std::shared_mutex::try_lock_shared, &std::shared_mutex::lock_shared);
+}
+
+bool
+InstrumentedRWLock::try_lock_shared() {
+    if (!_lock.try_lock_shared()) {
+        return false;
+    }
+    _site.acquisitions.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+} // end namespace jyq
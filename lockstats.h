@@ -0,0 +1,101 @@
+#ifndef LIBJYQ_LOCKSTATS_H__
+#define LIBJYQ_LOCKSTATS_H__
+/* C++ Implementation copyright (c)2019 Joshua Scoggins
+ * See LICENSE file for license details.
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+
+namespace jyq {
+    /**
+     * Type: LockSite
+     *
+     * Contention counters shared by every lock constructed with the
+     * same name, or, for unnamed locks, at the same source location.
+     * Times are in nanoseconds. Hold times are only kept for exclusive
+     * ownership.
+     */
+    struct LockSite {
+        explicit LockSite(const std::string& n) : name(n) { }
+        std::string name;
+        std::atomic<uint64_t> acquisitions { 0 };
+        std::atomic<uint64_t> contended { 0 };
+        std::atomic<uint64_t> waitTime { 0 };
+        std::atomic<uint64_t> maxWait { 0 };
+        std::atomic<uint64_t> holdTime { 0 };
+        std::atomic<uint64_t> maxHold { 0 };
+    };
+    LockSite& lockSite(const char* name, const char* file, int line);
+    /**
+     * Type: LockReport
+     *
+     * A copy of the counters of one T<LockSite>.
+     */
+    struct LockReport {
+        std::string name;
+        uint64_t acquisitions;
+        uint64_t contended;
+        uint64_t waitTime;
+        uint64_t maxWait;
+        uint64_t holdTime;
+        uint64_t maxHold;
+    };
+    /**
+     * Function: lockReport
+     * Function: printLockReport
+     *
+     * lockReport copies the counters of every lock site, the ones
+     * which made threads wait longest first. printLockReport writes the
+     * worst P<count> of them as a table, with times in microseconds.
+     */
+    std::vector<LockReport> lockReport();
+    void printLockReport(std::ostream& os, size_t count = 10);
+    /**
+     * Type: InstrumentedMutex
+     * Type: InstrumentedRWLock
+     *
+     * Drop in replacements for std::mutex and std::shared_mutex which
+     * keep T<LockSite> counters. An uncontended acquisition costs a
+     * try_lock and a clock read; a contended one also times the wait.
+     * They stand behind the T<Mutex> and T<RWLock> aliases when the
+     * library is built with JYQ_LOCK_STATS.
+     */
+    class InstrumentedMutex {
+        public:
+            explicit InstrumentedMutex(const char* name = nullptr, const char* file = __builtin_FILE(), int line = __builtin_LINE()) : _site(lockSite(name, file, line)) { }
+            InstrumentedMutex(const InstrumentedMutex&) = delete;
+            InstrumentedMutex& operator=(const InstrumentedMutex&) = delete;
+            void lock();
+            bool try_lock();
+            void unlock();
+        private:
+            std::mutex _lock;
+            LockSite& _site;
+            uint64_t _acquired = 0;
+    };
+    class InstrumentedRWLock {
+        public:
+            explicit InstrumentedRWLock(const char* name = nullptr, const char* file = __builtin_FILE(), int line = __builtin_LINE()) : _site(lockSite(name, file, line)) { }
+            InstrumentedRWLock(const InstrumentedRWLock&) = delete;
+            InstrumentedRWLock& operator=(const InstrumentedRWLock&) = delete;
+            void lock();
+            bool try_lock();
+            void unlock();
+            void lock_shared();
+            bool try_lock_shared();
+            void unlock_shared() { _lock.unlock_shared(); }
+        private:
+            std::shared_mutex _lock;
+            LockSite& _site;
+            uint64_t _acquired = 0;
+    };
+} // end namespace jyq
+
+#endif // end LIBJYQ_LOCKSTATS_H__
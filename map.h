@@ -8,6 +8,7 @@
 #include <functional>
 #include <map>
 #include <any>
+#include <optional>
 #include <utility>
 #include "types.h"
 
@@ -61,7 +62,7 @@ namespace jyq {
             std::shared_lock<RWLock> getReadLock() { return std::shared_lock<RWLock>(_lock); }
         private:
             BackingStore _map;
-            mutable RWLock _lock;
+            mutable RWLock _lock JYQ_LOCK_NAME("Map::_lock");
     };
 
 } // end namespace jyq
@@ -133,11 +133,48 @@ FROpen::packUnpack(Msg& msg) {
     }
 }
 void
+FTWalk::addWname(std::string_view value) {
+    if (size() >= maximum::Welem) {
+        throw Exception("Walk is limited to ", int(maximum::Welem), " names!");
+    }
+    _names.append(value);
+    _offsets[size() + 1] = _names.size();
+    setSize(size() + 1);
+}
+void
+FTWalk::clearWnames() noexcept {
+    _names.clear();
+    setSize(0);
+}
+void
 FTWalk::packUnpack(Msg& msg) {
     FHdr::packUnpack(msg);
     packUnpackFid(msg);
     msg.pu32(&_newfid);
-    msg.pstrings<maximum::Welem>(getSizeReference(), _wname);
+    uint16_t num = size();
+    msg.pu16(&num);
+    if (num > maximum::Welem) {
+        msg.setPos(msg.getEnd() + 1);
+        return;
+    }
+    if (msg.unpackRequested()) {
+        clearWnames();
+    }
+    for (auto i = 0; i < num; ++i) {
+        uint16_t len = 0;
+        if (msg.packRequested()) {
+            len = _offsets[i+1] - _offsets[i];
+        }
+        msg.pu16(&len);
+        if ((msg.getPos() + len) <= msg.getEnd()) {
+            if (msg.unpackRequested()) {
+                addWname(std::string_view(msg.getPos(), len));
+            } else {
+                _names.copy(msg.getPos(), len, _offsets[i]);
+            }
+        }
+        msg.advancePosition(len);
+    }
 }
 void
 FTFlush::packUnpack(Msg& msg) {
@@ -174,9 +211,28 @@ FIO::packUnpack(Msg& msg) {
     }
     msg.pu32(&getSizeReference());
     if (type == FType::RRead || type == FType::TWrite) {
-        msg.pdata(_data, size());
+        if (_shared && !msg.unpackRequested()) {
+            msg.pdata(*_shared, size());
+        } else {
+            msg.pdata(getData(), size());
+        }
     }
 }
+std::shared_ptr<const std::string>
+FIO::takeData() {
+    auto result = _shared ? std::move(_shared) : std::make_shared<const std::string>(std::move(_data));
+    reset();
+    return result;
+}
+std::string&
+FIO::getData() {
+    if (_shared) {
+        // a copy the caller may change
+        _data = *_shared;
+        _shared.reset();
+    }
+    return _data;
+}
 void
 FRStat::packUnpack(Msg& msg) {
     FHdr::packUnpack(msg);
@@ -195,72 +251,73 @@ FTWStat::packUnpack(Msg& msg) {
     msg.packUnpack(&_stat);
 }
 
-Fcall::VariantStorage
-Fcall::constructBlankStorage(const FHdr& hdr) {
-    Fcall::VariantStorage storage;
+void
+Fcall::reset(const FHdr& hdr) {
     switch (hdr.getType()) {
         case FType::TVersion:
         case FType::RVersion:
-            storage.emplace<FVersion>();
+            emplace<FVersion>();
             break;
         case FType::TFlush:
-            storage.emplace<FTFlush>();
+            emplace<FTFlush>();
             break;
         case FType::ROpen:
         case FType::RCreate:
         case FType::RAttach:
-            storage.emplace<FROpen>();
+            emplace<FROpen>();
             break;
         case FType::TError:
         case FType::RError:
-            storage.emplace<FError>();
+            emplace<FError>();
             break;
         case FType::RAuth:
-            storage.emplace<FRAuth>();
+            emplace<FRAuth>();
             break;
         case FType::TAttach:
         case FType::TAuth:
-            storage.emplace<FAttach>();
+            emplace<FAttach>();
             break;
         case FType::TCreate:
         case FType::TOpen:
-            storage.emplace<FTCreate>();
+            emplace<FTCreate>();
             break;
         case FType::TWalk:
-            storage.emplace<FTWalk>();
+            emplace<FTWalk>();
             break;
         case FType::RWalk:
-            storage.emplace<FRWalk>();
+            emplace<FRWalk>();
             break;
         case FType::TWStat:
-            storage.emplace<FTWStat>();
+            emplace<FTWStat>();
             break;
         case FType::RStat:
-            storage.emplace<FRStat>();
+            emplace<FRStat>();
             break;
         case FType::TWrite:
         case FType::RWrite:
         case FType::TRead:
         case FType::RRead:
-            storage.emplace<FIO>();
+            emplace<FIO>();
             break;
         case FType::TClunk:
         case FType::TRemove:
         case FType::TStat:
-            storage.emplace<FFullHeader>();
+            emplace<FFullHeader>();
             break;
         case FType::RClunk: // default cases
-            storage.emplace<FHdr>();
+        case FType::RFlush:
+        case FType::RRemove:
+        case FType::RWStat:
+            emplace<FHdr>();
             break;
         default:
+            _storage.reset();
+            _header = nullptr;
             throw Exception("Undefined or unimplemented type specified!");
     }
-    std::visit([&hdr](auto&& value) { 
-            value.setType(hdr.getType());
-            value.setTag(hdr.getTag());
-            value.setFid(hdr.getFid());
-            }, storage);
-    return storage;
+    _header->setType(hdr.getType());
+    _header->setTag(hdr.getTag());
+    _header->setFid(hdr.getFid());
 }
 
 void
@@ -274,7 +331,7 @@ Fcall::packUnpack(Msg& msg) {
             FHdr tmp;
             tmp.packUnpack(msg);
             msg.setPos(startPoint); // go back to where we started
-            _storage = constructBlankStorage(tmp);
+            reset(tmp);
         } else {
             throw Exception("Neither pack or unpack requested!");
         }
@@ -350,10 +407,41 @@ Msg::setData(char* value) noexcept {
     _data = value;
 }
 
+void
+MsgChain::append(char* data, size_t length) {
+    if (length > 0) {
+        _segments.push_back(iovec { data, length });
+    }
+}
+
+size_t
+MsgChain::size() const noexcept {
+    size_t total = 0;
+    for (const auto& seg : _segments) {
+        total += seg.iov_len;
+    }
+    return total;
+}
+
+uint
+MsgChain::pack(Msg& head, Fcall& value, const char* payload, uint length) {
+    clear();
+    if (auto total = head.pack(value); total == 0 || total < length) {
+        return 0;
+    } else {
+        // the payload region of head was skipped, not written, by pdata
+        append(head.getData(), total - length);
+        append(payload, length);
+        return total;
+    }
+}
+
 void
 Fcall::reset(FType type) {
-    // reallocate storage in all cases
-    _storage = constructBlankStorage(type);
+    // reconstruct storage in place in all cases
+    FHdr tmp;
+    tmp.setType(type);
+    reset(tmp);
 }
 
 } // end namespace jyq
@@ -0,0 +1,106 @@
+/* C++ Implementation copyright (c)2019 Joshua Scoggins
+ * See LICENSE file for license details.
+ */
+#include "pagecache.h"
+
+
+namespace jyq {
+bool
+PageCache::cacheable(const Qid& qid, uint8_t mode) noexcept {
+    constexpr auto Uncached = uint8_t(QType::DIR) | uint8_t(QType::APPEND) | uint8_t(QType::EXCL);
+    return !(qid.getType() & Uncached) && !(mode & uint8_t(OMode::DIRECT)) && qid.getVersion() != 0;
+}
+
+PageCache::Page
+PageCache::get(const Qid& qid, uint64_t block) {
+    std::lock_guard<Mutex> lock(_lock);
+    auto it = _pages.find(Key(qid.getPath(), block));
+    if (it == _pages.end()) {
+        _misses.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    if (it->second.version != qid.getVersion()) {
+        erase(it);
+        _misses.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    _lru.splice(_lru.begin(), _lru, it->second.lru);
+    _hits.fetch_add(1, std::memory_order_relaxed);
+    return it->second.data;
+}
+
+bool
+PageCache::contains(const Qid& qid, uint64_t block) {
+    std::lock_guard<Mutex> lock(_lock);
+    auto it = _pages.find(Key(qid.getPath(), block));
+    return it != _pages.end() && it->second.version == qid.getVersion();
+}
+
+void
+PageCache::put(const Qid& qid, uint64_t block, std::string data) {
+    std::lock_guard<Mutex> lock(_lock);
+    if (data.size() > _budget) {
+        return;
+    }
+    auto page = std::make_shared<const std::string>(std::move(data));
+    Key key(qid.getPath(), block);
+    if (auto it = _pages.find(key); it != _pages.end()) {
+        erase(it);
+    }
+    _lru.push_front(key);
+    _pages.emplace(key, Entry { qid.getVersion(), page, _lru.begin() });
+    _bytes += page->size();
+    shrink();
+}
+
+void
+PageCache::invalidate(uint64_t path) {
+    std::lock_guard<Mutex> lock(_lock);
+    for (auto it = _pages.lower_bound(Key(path, 0)); it != _pages.end() && it->first.first == path;) {
+        erase(it++);
+    }
+}
+
+void
+PageCache::clear() {
+    std::lock_guard<Mutex> lock(_lock);
+    _pages.clear();
+    _lru.clear();
+    _bytes = 0;
+}
+
+void
+PageCache::setBudget(size_t budget) {
+    std::lock_guard<Mutex> lock(_lock);
+    _budget = budget;
+    shrink();
+}
+
+PageCache::Stats
+PageCache::stats() {
+    std::lock_guard<Mutex> lock(_lock);
+    return Stats {
+        _hits.load(std::memory_order_relaxed),
+        _misses.load(std::memory_order_relaxed),
+        _evictions.load(std::memory_order_relaxed),
+        _pages.size(),
+        _bytes,
+    };
+}
+
+void
+PageCache::erase(std::map<Key, Entry>::iterator it) {
+    _bytes -= it->second.data->size();
+    _lru.erase(it->second.lru);
+    _pages.erase(it);
+}
+
+void
+PageCache::shrink() {
+    while (_bytes > _budget && !_lru.empty()) {
+        erase(_pages.find(_lru.back()));
+        _evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+} // end namespace jyq
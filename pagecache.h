@@ -0,0 +1,93 @@
+#ifndef LIBJYQ_PAGECACHE_H__
+#define LIBJYQ_PAGECACHE_H__
+/* C++ Implementation copyright (c)2019 Joshua Scoggins
+ * See LICENSE file for license details.
+ */
+
+#include <atomic>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include "types.h"
+#include "qid.h"
+
+
+namespace jyq {
+    /**
+     * Type: PageCache
+     *
+     * File contents kept by a T<Client>, in blocks of BlockSize bytes
+     * keyed by the qid path of their file and their index. Each block
+     * remembers the qid version it was read at: a lookup made with
+     * any other version misses and drops the block, so data is only
+     * served for as long as the server reports the file unchanged.
+     * A block shorter than BlockSize holds the end of the file.
+     *
+     * The least recently used blocks are evicted once their total
+     * size exceeds the budget. All members may be called from any
+     * thread.
+     *
+     * See also:
+     *	F<setCache>, F<pread>
+     */
+    class PageCache {
+        public:
+            static constexpr size_t BlockSize = 64 << 10;
+            using Page = std::shared_ptr<const std::string>;
+            struct Stats {
+                uint64_t hits;
+                uint64_t misses;
+                uint64_t evictions;
+                size_t pages;
+                size_t bytes;
+            };
+        public:
+            explicit PageCache(size_t budget) : _budget(budget) { }
+            PageCache(const PageCache&) = delete;
+            PageCache& operator=(const PageCache&) = delete;
+            /**
+             * @return the block, or nullptr if it is missing or was read at another version
+             */
+            Page get(const Qid& qid, uint64_t block);
+            bool contains(const Qid& qid, uint64_t block);
+            void put(const Qid& qid, uint64_t block, std::string data);
+            /**
+             * Drop every block of the file, after it was changed through this client.
+             */
+            void invalidate(uint64_t path);
+            void clear();
+            void setBudget(size_t budget);
+            size_t getBudget() const noexcept { return _budget; }
+            Stats stats();
+            /**
+             * Files are cached unless they are directories, append only
+             * or exclusive use files, were opened with OMode::DIRECT, or
+             * have qid version 0, which servers report for files whose
+             * changes they do not track.
+             */
+            static bool cacheable(const Qid& qid, uint8_t mode) noexcept;
+        private:
+            using Key = std::pair<uint64_t, uint64_t>;
+            struct Entry {
+                uint32_t version;
+                Page data;
+                std::list<Key>::iterator lru;
+            };
+            /* with the lock held */
+            void erase(std::map<Key, Entry>::iterator it);
+            void shrink();
+        private:
+            Mutex _lock JYQ_LOCK_NAME("PageCache::_lock");
+            size_t _budget;
+            size_t _bytes = 0;
+            std::map<Key, Entry> _pages;
+            std::list<Key> _lru; /* most recently used first */
+            std::atomic<uint64_t> _hits { 0 };
+            std::atomic<uint64_t> _misses { 0 };
+            std::atomic<uint64_t> _evictions { 0 };
+    };
+} // end namespace jyq
+
+#endif // end LIBJYQ_PAGECACHE_H__
@@ -0,0 +1,36 @@
+#ifndef LIBJYQ_PROBES_H__
+#define LIBJYQ_PROBES_H__
+/* C++ Implementation copyright (c)2019 Joshua Scoggins
+ * See LICENSE file for license details.
+ */
+
+/**
+ * Macro: JYQ_PROBE
+ *
+ * Marks a USDT static tracepoint named P<name> in the "jyq"
+ * provider, with up to twelve integer or pointer arguments. Double
+ * underscores in the name read as dashes to the tracing tools, so
+ * JYQ_PROBE(msg__recv, fd, size) is seen as usdt:...:jyq:msg-recv.
+ *
+ * When the library is built with JYQ_USDT defined (see config.mk),
+ * each probe is a single nop plus an ELF note that bpftrace, perf or
+ * systemtap use to attach to it at run time; the arguments are only
+ * materialized into registers. Without JYQ_USDT the probes expand to
+ * nothing and their arguments are not evaluated.
+ *
+ * Probes:
+ *	msg__recv(fd, size), msg__send(fd, size) - a 9P message crossed a connection
+ *	req__handle(tag, type, fid), req__respond(tag, type, error) - server side requests
+ *	rpc__send(tag, type), rpc__recv(tag, type) - client side requests
+ *	muxer__elect(waiting) - the client muxer role changes hands
+ *	tag__get(tag, inuse), tag__wait(inuse), tag__put(tag) - client tag allocation
+ *	timer__fire(id, late) - a timer is run, P<late> milliseconds after it was due
+ */
+#ifdef JYQ_USDT
+#include <sys/sdt.h>
+#define JYQ_PROBE(name, ...) STAP_PROBEV(jyq, name, ##__VA_ARGS__)
+#else
+#define JYQ_PROBE(name, ...) do { } while (false)
+#endif
+
+#endif // end LIBJYQ_PROBES_H__
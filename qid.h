@@ -18,9 +18,10 @@ namespace jyq {
         void setDirType(uint8_t dtype) noexcept { _dirType = dtype; }
         void packUnpack(Msg& msg);
         private:
-            uint8_t		_type;
-            uint32_t    _version;
+            // widest first so an array of Qids (FRWalk) carries no padding
             uint64_t    _path;
+            uint32_t    _version;
+            uint8_t		_type;
             uint8_t     _dirType;
     };
 } // end namespace jyq
@@ -13,6 +13,7 @@
 #include "Conn.h"
 #include "socket.h"
 #include "Server.h"
+#include "probes.h"
 
 
 namespace jyq {
@@ -50,14 +51,18 @@ Fid::Fid(uint32_t f, std::shared_ptr<Conn9> c) : _fid(f), _omode(-1), _conn(c) {
 }
 
 static Fid* 
-createfid(Fid::Map& map, int fid, std::shared_ptr<Conn9> p9conn) {
-    if (auto result = map.emplace(std::make_pair(fid, Fid(fid, p9conn))); result.second) {
-        return &result.first->second;
+createfid(Fid::Map& map, uint32_t fid, std::shared_ptr<Conn9> p9conn) {
+    if (auto result = map.emplace(fid, fid, p9conn); result.second) {
+        return result.first;
     } else {
         return nullptr;
     }
 }
 Fid::~Fid() {
+    if (!_conn) {
+        // moved from, the live Fid is responsible for cleanup
+        return;
+    }
     if (auto srv = this->getConn()->getSrv(); srv) {
        if (srv->freefid) {
            srv->freefid(this);
@@ -69,10 +74,15 @@ Fid::~Fid() {
 void
 Conn::handleFcall() {
 	Fcall fcall;
+    std::optional<AllocScope> phase;
+    phase.emplace(AllocPhase::Decode);
 
     auto p9conn = this->unpackAux<std::shared_ptr<Conn9>>();
     auto rlock = p9conn->getReadLock();
-    if (this->recvmsg(p9conn->getRMsg()) == 0) {
+    auto size = this->recvmsg(p9conn->getRMsg());
+    // only statistics time the request as a whole
+    auto received = p9conn->getSrv()->stats ? nsec() : 0;
+    if (size == 0) {
         rlock.unlock();
         // hangup(this); // NOPE!
         return;
@@ -83,17 +93,32 @@ Conn::handleFcall() {
         return;
     }
     rlock.unlock();
+    phase->setType(fcall.getType());
+    phase.emplace(AllocPhase::Dispatch, fcall.getType());
+    countRequest(fcall.getType());
+    trace(TraceEvent::Received, fcall.getType(), fcall.getTag(), fcall.getFid(), size);
+    if (auto stats = p9conn->getSrv()->stats.get(); stats) {
+        stats->received(fcall.getType(), size);
+    }
 
     //p9conn->operator++();
-    Req9 req;
-    req.setConn(p9conn);
-    req.setSrv(p9conn->getSrv());
-    req.setIFcall(fcall);
     p9conn->setConn(this);
-
-    if (auto result = p9conn->getTagMap().emplace(fcall.getTag(), req); result.second) {
-        result.first->second.handle();
+    auto setup = [&p9conn, &fcall, received](Req9& req) {
+        req.setConn(p9conn);
+        req.setSrv(p9conn->getSrv());
+        req.setReceived(received);
+        req.setIFcall(std::move(fcall));
+    };
+    // build the request directly in its tag slot
+    if (auto result = p9conn->getTagMap().emplace(fcall.getTag()); result.second) {
+        setup(*result.first);
+        // fcall was moved into the request
+        auto& ifcall = result.first->getIFcall();
+        trace(TraceEvent::Dispatched, ifcall.getType(), ifcall.getTag(), ifcall.getFid());
+        result.first->handle();
     } else {
+        Req9 req;
+        setup(req);
         req.respond(Eduptag);
     }
 }
@@ -102,9 +127,19 @@ Conn9::retrieveTag(uint16_t id) {
     return _tagmap.get(id);
 }
 
+bool
+Conn9::removeTag(uint16_t id) {
+    return _tagmap.erase(id);
+}
+
 Fid*
 Conn9::retrieveFid(int id) {
-    return _fidmap.get(id);
+    return _fidmap.get(uint32_t(id));
+}
+
+bool
+Conn9::removeFid(int id) {
+    return _fidmap.erase(uint32_t(id));
 }
 void
 Req9::handle() {
@@ -112,6 +147,20 @@ Req9::handle() {
 	if(printfcall) {
 		printfcall(&getIFcall());
     }
+    // the response is built in place by the handler and sent as is by respond
+    getOFcall().reset(FType(uint8_t(getIFcall().getType()) + 1));
+    getOFcall().setTag(getIFcall().getTag());
+    // a synchronous respond releases this request, keep what the trace needs
+    auto type = getIFcall().getType();
+    auto tag = getIFcall().getTag();
+    auto fid = getIFcall().getFid();
+    trace(TraceEvent::HandlerStart, type, tag, fid);
+    JYQ_PROBE(req__handle, tag, uint8_t(type), fid);
+    auto conn = _conn->getConn();
+    auto watchdog = conn ? conn->getServer().getWatchdog() : nullptr;
+    auto fd = conn ? int(conn->getConnection().getFid()) : -1;
+    auto start = watchdog ? nsec() : 0;
+    AllocScope allocations(AllocPhase::Handler, type);
     getIFcall().visit([this, srv = _conn->getSrv()](auto&& value) {
                 using K = std::decay_t<decltype(value)>;
                 if constexpr (std::is_same_v<K, FTWStat>) {
@@ -312,6 +361,10 @@ Req9::handle() {
                     respond(Enofunc);
                 }
             });
+    if (watchdog) {
+        watchdog->handled(type, tag, fid, fd, nsec() - start);
+    }
+    trace(TraceEvent::HandlerEnd, type, tag, fid);
 }
 
 /**
@@ -331,8 +384,16 @@ void
 Req9::respond(const char *error) {
 
 	auto p9conn = _conn;
-    getIFcall().visit([this, &error, &p9conn](auto&& value) {
+    AllocScope allocations(AllocPhase::Respond, getIFcall().getType());
+    auto dispatched = !getOFcall().empty();
+    trace(TraceEvent::Responded, getIFcall().getType(), getIFcall().getTag(), getIFcall().getFid());
+    JYQ_PROBE(req__respond, getIFcall().getTag(), uint8_t(getIFcall().getType()), error);
+    getIFcall().visit([this, &error, &p9conn, dispatched](auto&& value) {
             using K = std::decay_t<decltype(value)>;
+            if (!dispatched) {
+                // rejected before handle, there is no fid or tag state to unwind
+                return;
+            }
             // Still to be implemented: auth 
             if constexpr (std::is_same_v<K, FVersion>) {
                 int msize = 0;
@@ -375,7 +436,7 @@ Req9::respond(const char *error) {
                         _newfid->setQid(getOFcall().getRwalk().getWqid()[getOFcall().getRwalk().size()-1]);
                     }
                 }
-                value.getWname().fill("");
+                value.clearWnames();
             } else if constexpr (std::is_same_v<K, FIO>) {
                 switch (value.getType()) {
                     case FType::TWrite:
@@ -411,29 +472,51 @@ Req9::respond(const char *error) {
             }
             });
 
-    getOFcall().setTag(getIFcall().getTag());
-
-    if (!error) {
-        getOFcall().reset(FType(((uint8_t)getIFcall().getType()) + 1));
-    } else {
-        getOFcall().reset(FType::RError);
+    if (error) {
+        getOFcall().emplace<FError>().setType(FType::RError);
 		getOFcall().getError().setEname(error);
-	}
+	} else if (getOFcall().empty()) {
+        getOFcall().reset(FType(((uint8_t)getIFcall().getType()) + 1));
+    }
+    getOFcall().setTag(getIFcall().getTag());
 
 	if(printfcall) {
 		printfcall(&getOFcall());
     }
 
-    p9conn->removeTag(getIFcall().getTag());
-
     if (p9conn->getConn()) {
 
         auto theLock = p9conn->getWriteLock();
-        auto msize = p9conn->getWMsg().pack(getOFcall());
-        if (p9conn->sendmsg() != msize) {
+        uint msize = 0, sent = 0;
+        if (getOFcall().getType() == FType::RRead) {
+            // the data goes out from where the handler left it, not through the message buffer
+            auto& rread = getOFcall().getRRead();
+            auto data = rread.takeData();
+            rread.setSize(std::min<size_t>(rread.size(), data->size()));
+            MsgChain chain;
+            {
+                AllocScope encode(AllocPhase::Encode, getIFcall().getType());
+                msize = chain.pack(p9conn->getWMsg(), getOFcall(), data->data(), rread.size());
+            }
+            sent = p9conn->sendmsg(chain);
+        } else {
+            {
+                AllocScope encode(AllocPhase::Encode, getIFcall().getType());
+                msize = p9conn->getWMsg().pack(getOFcall());
+            }
+            sent = p9conn->sendmsg();
+        }
+        if (sent != msize) {
 			//hangup(p9conn->getConn());
             //hmmm, how to describe that we did a hangup?
         }
+        trace(TraceEvent::Sent, getIFcall().getType(), getIFcall().getTag(), getIFcall().getFid(), msize);
+        if (auto stats = p9conn->getSrv()->stats.get(); stats && _received) {
+            stats->responded(getIFcall().getType(), msize, nsec() - _received);
+            if (error) {
+                stats->failed(error);
+            }
+        }
 	}
     getOFcall().visit([](auto&& value) {
                 using K = std::decay_t<decltype(value)>;
@@ -447,6 +530,11 @@ Req9::respond(const char *error) {
                     // do nothing
                 }
             });
+    // releasing the tag destroys this request, so it must come last. A
+    // duplicate tag must not release the request that owns the tag.
+    if (auto tag = getIFcall().getTag(); p9conn->retrieveTag(tag) == this) {
+        p9conn->removeTag(tag);
+    }
 	//decref_p9conn(p9conn);
 }
 
@@ -457,20 +545,20 @@ Conn::cleanup() {
     p9conn->setConn(nullptr);
     ReqList collection;
     if (p9conn.use_count() > 1) {
-        p9conn->fidExec<ReqList&>([](auto context, Fid::Map::iterator arg) {
+        p9conn->fidExec<ReqList&>([](auto& context, Fid& arg) {
                 context.emplace_back();
                 context.back().getIFcall().reset(FType::TClunk);
                 context.back().getIFcall().setNoTag();
-                context.back().getIFcall().setFid(arg->second.getId());
-                context.back().setFid(&arg->second);
-                context.back().setConn(arg->second.getConn());
+                context.back().getIFcall().setFid(arg.getId());
+                context.back().setFid(&arg);
+                context.back().setConn(arg.getConn());
                 }, collection);
-        p9conn->tagExec<ReqList>([](auto context, Conn9::TagMap::iterator arg) {
+        p9conn->tagExec<ReqList&>([](auto& context, Req9& arg) {
                     context.emplace_back();
                     context.back().getIFcall().reset(FType::TFlush);
                     context.back().getIFcall().setNoTag();
-                    context.back().getIFcall().getTflush().setOldTag(arg->second.getIFcall().getTag());
-                    context.back().setConn(arg->second.getConn());
+                    context.back().getIFcall().getTflush().setOldTag(arg.getIFcall().getTag());
+                    context.back().setConn(arg.getConn());
                 }, collection);
 	}
     for (auto& req : collection) {
@@ -510,9 +598,13 @@ Conn::serve9conn() {
 	if(auto fd = accept(_fd, nullptr, nullptr); fd < 0) {
 		return;
     } else {
-        auto p9conn = std::make_shared<Conn9>();
+        auto srv = unpackAux<Srv9*>();
+        auto p9conn = std::make_shared<Conn9>(srv->fidMode);
         //++p9conn;
-        p9conn->setSrv(unpackAux<Srv9*>());
+        p9conn->setSrv(srv);
+        if (srv->stats) {
+            srv->stats->track(p9conn, fd);
+        }
         p9conn->alloc(1024);
         _srv.listen(fd, p9conn, &Conn::handleFcall, &Conn::cleanup);
     }
@@ -5,11 +5,14 @@
 #include <cstdlib>
 #include <cstdio>
 #include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
 #include "Rpc.h"
 #include "Msg.h"
 #include "Client.h"
 #include "socket.h"
 #include "util.h"
+#include "probes.h"
 
 namespace jyq {
 RpcBody::RpcBody() : _tag(0), _p(nullptr), _waiting(true), _async(false) { }
@@ -17,10 +20,42 @@ RpcBody::RpcBody() : _tag(0), _p(nullptr), _waiting(true), _async(false) { }
 std::unique_ptr<Fcall>
 Client::muxrecv()
 {
+    /* size[4] type[1] tag[2] count[4]: enough to tell an Rread and the rpc it answers */
+    constexpr auto RreadHead = 11u;
 	//Fcall *f = nullptr;
     auto theRlock = getReadLock();
-    if (fd.recvmsg(_rmsg) == 0) {
+    MsgChain into;
+    auto placed = false;
+    auto payload = [this, &into, &placed](Msg& head, uint32_t rest) -> MsgChain* {
+        auto data = head.getData();
+        if (head.getPos() - data < RreadHead || FType(uint8_t(data[4])) != FType::RRead) {
+            return nullptr;
+        }
+        int tag = (uint8_t(data[5]) | uint8_t(data[6]) << 8) - _mintag;
+        auto lk = getLock();
+        auto slot = tag < 0 ? nullptr : wait.find(tag);
+        if (!slot || !*slot || !(*slot)->getContents().getInto() || (*slot)->getContents().getIntoLength() < rest) {
+            return nullptr;
+        }
+        into.append((*slot)->getContents().getInto(), rest);
+        placed = true;
+        return &into;
+    };
+    if (fd.recvmsg(_rmsg, RreadHead, payload) == 0) {
         return nullptr;
+    }
+    if (placed) {
+        /* the data is where the rpc wanted it already, so the reply only counts it */
+        auto f = std::make_unique<Fcall>();
+        f->reset(FType::RRead);
+        _rmsg.setPos(_rmsg.getData() + 5);
+        uint16_t tag = 0;
+        uint32_t count = 0;
+        _rmsg.pu16(&tag);
+        _rmsg.pu32(&count);
+        f->setTag(tag);
+        f->getRRead().setSize(count);
+        return f;
     }
 	if(auto f = std::make_unique<Fcall>(); _rmsg.unpack(*f) == 0) {
         return nullptr;
@@ -36,111 +71,269 @@ Client::electmuxer()
 	/* if there is anyone else sleeping, wake them to mux */
     for(auto rpc=sleep->getNext(); rpc != sleep; rpc = rpc->getNext()) {
         if (!rpc->getContents().isAsync()) {
+            JYQ_PROBE(muxer__elect, wait.size());
             muxer = rpc;
+            _muxthread = std::thread::id();
             rpc->getContents().getRendez().notify_one();
 			return;
 		}
 	}
     muxer.reset();
+    _muxthread = std::thread::id();
+    /* a caller waiting for a tag or in await must now read replies itself */
+    if (_tagwaiters.load() > 0) {
+        _tagrend.notify_all();
+    }
+    if (_awaiters.load() > 0) {
+        _awaitrend.notify_all();
+    }
 }
-int 
-Client::gettag(Rpc &r, Lock& lock)
+/*
+ * Takes a tag without the lock: only when every tag is in use does
+ * the caller lock and wait until puttag frees one. It reads replies
+ * itself while nobody else does, as no tag would be freed otherwise.
+ */
+int
+Client::gettag(Rpc& r)
 {
-	int i, mw;
-    auto Found = [this, &r](auto index) {
-        _nwait++;
-        wait[index] = r;
-        r->getContents().setTag(index + _mintag);
-        return r->getContents().getTag();
-    };
-	for(;;){
-		/* wait for a free tag */
-		while(_nwait == _mwait){
-			if(_mwait < (_maxtag-_mintag)) {
-				mw = _mwait;
-				if(mw == 0) {
-					mw = 1;
+    uint32_t i;
+    if (!wait.get(i)) {
+        auto lock = getLock();
+        ++_tagwaiters;
+        try {
+            while (!wait.get(i)) {
+                JYQ_PROBE(tag__wait, wait.size());
+                if (!muxer.lock()) {
+                    takemuxer(_poller);
+                    readone(lock, nullptr);
+                } else if (holdsmuxer()) {
+                    // a completion on the thread reading replies, which nobody reads for meanwhile
+                    if (!readone(lock, nullptr)) {
+                        throw Exception("broken pipe");
+                    }
                 } else {
-					mw <<= 1;
+                    _tagrend.wait(lock);
                 }
-                wait.resize(mw, nullptr);
-				_freetag = _mwait;
-				_mwait = mw;
-				break;
-			}
-            _tagrend.wait(lock);
-		}
-
-		i=_freetag;
-		if(wait[i] == nullptr) {
-            return Found(i);
-        }
-		for(; i<_mwait; i++) {
-			if(wait[i] == 0) {
-                return Found(i);
             }
+        } catch (...) {
+            --_tagwaiters;
+            throw;
         }
-		for(i=0; i<_freetag; i++) {
-			if(wait[i] == 0) {
-                return Found(i);
-            }
-        }
-		/* should not fall out of while without free tag */
-        throw "Fell out of loop without free tag!";
-	}
-
+        --_tagwaiters;
+    }
+    r->getContents().setTag(i + _mintag);
+    JYQ_PROBE(tag__get, r->getContents().getTag(), wait.size());
+    return r->getContents().getTag();
 }
 
+/* with the lock held */
 void
 Client::puttag(Rpc& r)
 {
 	auto i = r->getContents().getTag() - _mintag;
+    JYQ_PROBE(tag__put, r->getContents().getTag());
     if (wait[i] != r) {
         // assert(wait[i] == r);
         throw Exception("wait[",i,"] does not equal r");
     }
 	wait[i] = nullptr;
-	_nwait--;
-	_freetag = i;
-    _tagrend.notify_one();
+    wait.put(i);
+    if (_tagwaiters.load() > 0) {
+        _tagrend.notify_one();
+    }
     //r->getContents().getRendez().deactivate();
 }
+/*
+ * With the write lock held, while the connection takes no more: the
+ * server may be blocked sending replies nobody reads, so read one if
+ * nobody else does. Completions wait in finished until the write lock
+ * is dropped, as they may send rpcs of their own.
+ */
+void
+Client::stalled(std::vector<Rpc>& finished) {
+    /* whoever reads may stop, so look again now and then */
+    constexpr auto Recheck = 10; // ms
+    pollfd pfd { fd.getFid(), POLLOUT, 0 };
+    auto lk = getLock();
+    auto reading = holdsmuxer() || !muxer.lock();
+    if (reading) {
+        if (!muxer.lock()) {
+            takemuxer(_poller);
+        }
+        pfd.events |= POLLIN;
+    }
+    lk.unlock();
+    ::poll(&pfd, 1, reading ? -1 : Recheck);
+    lk.lock();
+    if (reading && (pfd.revents & POLLIN)) {
+        readone(lk, &finished);
+    } else if (muxer.lock() == _poller) {
+        electmuxer();
+    }
+}
+
+/*
+ * With the lock held, by a caller which took the reading role as
+ * _poller or is the reader thread: read and dispatch one reply, and
+ * hand the role on unless the caller is the reader. The completion of
+ * an asynchronous rpc runs here, or waits in later if given. Returns
+ * false on eof.
+ */
 bool
-Client::sendrpc(Rpc& r, Fcall& f) {
+Client::readone(Lock& lk, std::vector<Rpc>* later) {
+    auto handover = muxer.lock() == _poller;
+    lk.unlock();
+    std::shared_ptr<Fcall> p;
+    try {
+        p.reset(muxrecv().release());
+    } catch (...) {
+        lk.lock();
+        if (handover) {
+            electmuxer();
+        }
+        throw;
+    }
+    lk.lock();
+    if (!p) {
+        if (!later) {
+            failasync(lk);
+        }
+        if (handover) {
+            electmuxer();
+        }
+        return false;
+    }
+    lk.unlock();
+    auto r = dispatchandqlock(p, lk);
+    if (handover) {
+        electmuxer();
+    }
+    if (!r->getContents().isAsync()) {
+        r->getContents().getRendez().notify_one();
+    } else if (later) {
+        later->push_back(r);
+    } else {
+        finish(r, lk);
+    }
+    return true;
+}
+
+/* with the write lock held: a Twrite goes out from where its data is, not through _wmsg */
+bool
+Client::send(Fcall& f, const char* payload, std::vector<Rpc>& finished) {
+    MsgChain chain;
+    std::shared_ptr<const std::string> data;
+    if (f.getType() != FType::TWrite) {
+        if (!getWmsg().pack(f)) {
+            return false;
+        }
+        chain.appendHeader(_wmsg);
+    } else {
+        data = f.getTWrite().takeData();
+        if ((!payload && data->size() < f.getTWrite().size())
+                || !chain.pack(_wmsg, f, payload ? payload : data->data(), f.getTWrite().size())) {
+            f.getTWrite().setData(std::move(data));
+            return false;
+        }
+    }
+    auto sent = getConnection().sendmsg(chain, [this, &finished] { stalled(finished); });
+    if (data) {
+        f.getTWrite().setData(std::move(data));
+    }
+    return sent;
+}
+bool
+Client::sendrpc(Rpc& r, Fcall& f, const char* payload) {
+    f.setTag(gettag(r));
     { 
         auto lk = getLock();
-        r->getContents().setTag(gettag(r, lk));
-        f.setTag(r->getContents().getTag());
+        wait[f.getTag() - _mintag] = r;
         enqueue(r);
     }
+    std::vector<Rpc> finished;
+    auto sent = true;
     { 
         auto wlock = getWriteLock();
-        if (!getWmsg().pack(f) || !getConnection().sendmsg(_wmsg)) {
+        if (!send(f, payload, finished)) {
             auto lk = getLock();
             dequeue(r);
             puttag(r);
-            return false;
+            sent = false;
         }
     }
-    return true;
+    if (!finished.empty()) {
+        auto lk = getLock();
+        for (auto& r2 : finished) {
+            finish(r2, lk);
+        }
+    }
+    return sent;
 }
 
-void
+Rpc
 Client::dispatchandqlock(std::shared_ptr<Fcall> f, Lock& m)
 {
 	int tag = f->getTag() - _mintag;
     m.lock();
 	/* hand packet to correct sleeper */
-	if(tag < 0 || tag >= _mwait) {
-        throw Exception("libjyq: received unfeasible tag: ", f->getTag(), "(min: ", _mintag, ", max: ", _mintag+_mwait, ")\n");
+    auto slot = tag < 0 ? nullptr : wait.find(tag);
+	if(!slot) {
+        throw Exception("libjyq: received unfeasible tag: ", f->getTag(), "(min: ", _mintag, ", max: ", _mintag+wait.limit(), ")\n");
 	}
-	auto r2 = wait[tag];
+	auto r2 = *slot;
     if (!r2 || !(r2->getPrevious())) {
         throw Exception("libjyq: received message with bad tag\n");
 	}
 	r2->getContents().setP(f);
     dequeue(r2);
-    r2->getContents().getRendez().notify_one();
+    return r2;
+}
+
+/* with the lock held: release the tag of an asynchronous rpc and run its completion unlocked */
+void
+Client::finish(Rpc& r, Lock& lock) {
+    puttag(r);
+    lock.unlock();
+    JYQ_PROBE(rpc__recv, r->getContents().getTag(), uint8_t(r->getContents().getP() ? r->getContents().getP()->getType() : FType::TError));
+    r->getContents().complete();
+    lock.lock();
+    ++_completions;
+    if (_awaiters.load() > 0) {
+        _awaitrend.notify_all();
+    }
+}
+
+/* with the lock held: this thread reads replies from now on */
+void
+Client::takemuxer(const Rpc& r) {
+    muxer = r;
+    _muxthread = std::this_thread::get_id();
+}
+
+void
+Client::awaitturn(const std::function<bool()>& ready) {
+    auto lk = getLock();
+    auto seen = _completions;
+    ++_awaiters;
+    _awaitrend.wait(lk, [&] { return _completions != seen || ready() || (!muxer.lock() && !wait.empty()); });
+    --_awaiters;
+}
+
+/* with the lock held: the connection is gone, fail every asynchronous rpc still waiting */
+void
+Client::failasync(Lock& lock) {
+    std::list<Rpc> failed;
+    for (auto rpc = sleep->getNext(); rpc != sleep;) {
+        auto next = rpc->getNext();
+        if (rpc->getContents().isAsync()) {
+            dequeue(rpc);
+            failed.push_back(rpc);
+        }
+        rpc = next;
+    }
+    for (auto& rpc : failed) {
+        finish(rpc, lock);
+    }
 }
 void
 Client::enqueue(Rpc& r) {
@@ -156,28 +349,52 @@ Client::dequeue(Rpc& r) {
     r->getPrevious()->setNext(r->getNext());
     r->clearLinks();
 }
+namespace {
+/*
+ * A thread waits for one reply at a time, so muxrpc keeps reusing the
+ * same rpc. It only needs a new one when a completion run while it
+ * waits issues an rpc of its own, or when the thread that read its
+ * reply still holds it.
+ */
+Rpc
+syncrpc() {
+    thread_local Rpc cached;
+    if (!cached || cached.use_count() > 1) {
+        cached = std::make_shared<BareRpc>();
+    } else {
+        cached->getContents().reset();
+    }
+    return cached;
+}
+} // end namespace
+
 std::shared_ptr<Fcall>
 Client::muxrpc(Fcall& tx) 
 {
-    Rpc r = std::make_shared<BareRpc>();
+    Rpc r = syncrpc();
     std::shared_ptr<Fcall> p;
 
     if (!sendrpc(r, tx)) {
         return nullptr;
     }
+    JYQ_PROBE(rpc__send, tx.getTag(), uint8_t(tx.getType()));
     auto currentLock = getLock();
+    /* called from a completion run by the muxer, which nobody else would wake */
+    auto nested = holdsmuxer();
 	/* wait for our packet */
-	while(muxer.lock() && (muxer.lock() != r) && !r->getContents().getP()) {
+	while(!nested && muxer.lock() && (muxer.lock() != r) && !r->getContents().getP()) {
         r->getContents().getRendez().wait(currentLock);
     }
 
-	/* if not done, there's no muxer; start muxing */
+	/* if not done, there's no muxer, or this thread is it already; start muxing */
 	if(!r->getContents().getP()){
-        if (!(muxer.lock() == nullptr || muxer.lock() == r)) {
+        if (!nested && !(muxer.lock() == nullptr || muxer.lock() == r)) {
             //assert(muxer.lock() == nullptr || muxer.lock() == r);
             throw Exception("muxer check failed!");
         }
-        muxer = r;
+        if (!nested) {
+            takemuxer(r);
+        }
 		while(!r->getContents().getP()){
             currentLock.unlock();
             p.reset(muxrecv().release());
@@ -185,19 +402,157 @@ Client::muxrpc(Fcall& tx)
 				/* eof -- just give up and pass the buck */
                 currentLock.lock();
                 dequeue(r);
+                failasync(currentLock);
 				break;
 			}
-			dispatchandqlock(p, currentLock);
+			if (auto r2 = dispatchandqlock(p, currentLock); r2->getContents().isAsync()) {
+                finish(r2, currentLock);
+            } else {
+                r2->getContents().getRendez().notify_one();
+            }
 		}
-		electmuxer();
+        if (!nested) {
+            electmuxer();
+        }
 	}
     p = r->getContents().getP();
 	puttag(&r);
     if (!p) {
         throw Exception("unexpected eof");
     }
+    JYQ_PROBE(rpc__recv, p->getTag(), uint8_t(p->getType()));
 	return p;
 }
-} // end namespace jyq
 
+/**
+ * Function: asyncrpc
+ * Function: poll
+ *
+ * asyncrpc sends P<tx> and returns without waiting for the
+ * reply. P<done> is called exactly once: with the reply, or with
+ * nullptr if P<tx> could not be sent or the connection was lost
+ * first. It is called without any lock of the client held, and may
+ * issue further rpcs, blocking ones included: if the thread running
+ * it is the one reading replies, they go on reading for themselves.
+ *
+ * asyncread sends a Tread the same way, and has the data of its
+ * Rread read straight into P<into>, which must hold the count the
+ * Tread asks for and stay valid until P<done> is called. The reply
+ * then carries only the count, and no data of its own; a reply
+ * which does not fit is delivered as asyncrpc would. The data of a Twrite given a P<payload> is sent
+ * from there instead, which need only stay valid until asyncrpc
+ * returns. While every tag is in use, or the connection takes no
+ * more, asyncrpc reads replies itself if nobody else does, so that
+ * a lone thread never waits on replies left unread; completions it
+ * reads meanwhile may run on it before it returns.
+ *
+ * Replies are read by one thread at a time. A thread blocked in
+ * F<muxrpc> reads them while it waits for its own, and otherwise
+ * poll reads and dispatches a single one. poll returns false
+ * without reading if no rpc is outstanding or another thread is
+ * already reading, and when the connection is lost.
+ *
+ * See also:
+ *	F<muxrpc>, F<await>, F<startReader>
+ */
+bool
+Client::asyncrpc(Fcall& tx, Completion done, const char* payload) {
+    Rpc r = std::make_shared<BareRpc>();
+    return asyncsend(r, tx, std::move(done), payload);
+}
+
+bool
+Client::asyncread(Fcall& tread, char* into, Completion done) {
+    Rpc r = std::make_shared<BareRpc>();
+    r->getContents().setInto(into, tread.getTRead().size());
+    return asyncsend(r, tread, std::move(done), nullptr);
+}
+
+bool
+Client::asyncsend(Rpc& r, Fcall& tx, Completion done, const char* payload) {
+    r->getContents().setAsync();
+    r->getContents().setCompletion(std::move(done));
+    if (!sendrpc(r, tx, payload)) {
+        r->getContents().complete();
+        return false;
+    }
+    JYQ_PROBE(rpc__send, tx.getTag(), uint8_t(tx.getType()));
+    return true;
+}
+
+bool
+Client::poll() {
+    auto lk = getLock();
+    if (wait.empty()) {
+        return false;
+    }
+    if (muxer.lock()) {
+        // a completion on the thread reading replies reads on for itself
+        return holdsmuxer() && readone(lk, nullptr);
+    }
+    takemuxer(_poller);
+    return readone(lk, nullptr);
+}
+
+/**
+ * Function: startReader
+ * Function: hasReader
+ *
+ * startReader starts a thread which reads every reply from then
+ * on, so that no caller of F<muxrpc> ever becomes the muxer. Each
+ * caller sleeps until the reader hands it its reply, which costs
+ * one wakeup, where otherwise the reading role is passed between
+ * callers and the one holding it has to wake the next in line as
+ * well. A lone caller, which would have read its own reply, pays a
+ * context switch instead, so the reader pays off with many threads
+ * sharing the client or many asynchronous rpcs, whose replies it
+ * drains even when nobody calls F<poll>. Completions of
+ * F<asyncrpc> run on the reader thread, and poll returns false on
+ * any other.
+ *
+ * It must be started before any rpc is outstanding. The thread
+ * ends once the connection is lost or the client is destroyed,
+ * after which callers read replies themselves again, as they did
+ * before.
+ */
+void
+Client::startReader() {
+    auto lk = getLock();
+    if (hasReader() || !wait.empty() || muxer.lock()) {
+        throw Exception("startReader: replies are already being read");
+    }
+    muxer = _readrpc;
+    _reader = std::thread([this] { readloop(); });
+    _muxthread = _reader.get_id();
+}
 
+void
+Client::readloop() {
+    Lock lk(_lk, std::defer_lock);
+    try {
+        for (;;) {
+            std::shared_ptr<Fcall> p(muxrecv().release());
+            if (!p) {
+                break;
+            }
+            if (auto r = dispatchandqlock(p, lk); r->getContents().isAsync()) {
+                finish(r, lk);
+                lk.unlock();
+            } else {
+                // wake the caller once it can take the lock
+                lk.unlock();
+                r->getContents().getRendez().notify_one();
+            }
+        }
+    } catch (Exception&) {
+        // a reply the client cannot make sense of: drop the connection as for eof
+        fd.shutdown(SHUT_RDWR);
+    }
+    if (!lk.owns_lock()) {
+        lk.lock();
+    }
+    /* pass the reading role to a waiting caller, which will meet the eof in turn */
+    failasync(lk);
+    electmuxer();
+}
+} // end namespace jyq
@@ -110,6 +110,9 @@ Server::handleConns() {
  * P<srv>->running becomes false, or when select(2) returns an
  * error other than EINTR.
  *
+ * When a T<Watchdog> is installed, the time from select(2)
+ * returning until it is called again is reported to it.
+ *
  * Returns:
  *	Returns false when the loop exits normally, and true when
  *	it exits on error. V<errno> or the return value of
@@ -121,6 +124,7 @@ Server::handleConns() {
 bool
 Server::serverloop() {
 	timeval tv;
+    uint64_t awake = 0; /* when select last returned */
 
     setIsRunning();
 	while(isRunning()) {
@@ -137,12 +141,17 @@ Server::serverloop() {
         }
 
         prepareSelect();
+        if (auto watchdog = getWatchdog(); watchdog && awake) {
+            watchdog->iteration(nsec() - awake);
+        }
 		if (auto r = ::select(_maxfd + 1, &_rd, 0, 0, tvp); r < 0) {
+            awake = 0;
 			if(errno == EINTR) {
 				continue;
             }
 			return true;
 		}
+        awake = getWatchdog() ? nsec() : 0;
         handleConns();
 	}
 	return false;
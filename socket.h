@@ -69,6 +69,24 @@ namespace jyq {
              * @return the number of bytes received, zero means error happened, use errbuf to get message
              */
             uint recvmsg(Msg& msg);
+            /**
+             * Read a message whose first headLength bytes land in head, and
+             * whose remainder goes where payload says once it has seen them.
+             * @param head the buffer receiving the size field and header
+             * @param headLength the number of leading bytes, including the size field, read first
+             * @param payload given head and the length of the rest, the chain to scatter the rest
+             * into, or nullptr to read it into head after the header
+             * @return the number of bytes received, zero means error happened
+             */
+            using Payload = std::function<MsgChain*(Msg& head, uint32_t rest)>;
+            uint recvmsg(Msg& head, uint headLength, const Payload& payload);
+            /**
+             * Write a scatter-gather message to this connection with writev(2).
+             * @param chain the segments making up the message, in wire order
+             * @param stalled if given, called instead of blocking whenever the connection takes no more, to wait for it
+             * @return number of bytes written
+             */
+            uint sendmsg(MsgChain& chain, const std::function<void()>& stalled = nullptr);
             bool shutdown(int how);
             bool close();
             operator int() const;
@@ -77,6 +95,7 @@ namespace jyq {
         private:
             int mread(Msg& msg, size_t count);
             int readn(Msg& msg, size_t count);
+            size_t readv(MsgChain& chain, size_t count);
         private:
             int _fid;
     };
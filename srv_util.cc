@@ -1,6 +1,7 @@
 /* Copyright ©2006-2010 Kris Maglione <maglione.k at Gmail>
  * See LICENSE file for license details.
  */
+#include <algorithm>
 #include <ctype.h>
 #include <cstdarg>
 #include <cstdbool>
@@ -8,10 +9,12 @@
 #include <cstring>
 #include <ctime>
 #include <unistd.h>
+#include <vector>
 #include "jyq_util.h"
 
 namespace jyq {
 static std::string Enofile("file not found");
+static std::string Ebadoffset("bad offset in directory read");
 
 constexpr auto computeQIDValue(int64_t t, int64_t i) noexcept {
     return int64_t((t & 0xFF)<<32) | int64_t(i & 0xFFFF'FFFF);
@@ -47,7 +50,7 @@ srv_getfile() {
  *	F<srv_getfile>
  */
 void
-srv_freefile(FileId *) {
+srv_freefile(FileId&) {
     // this function is irrelevant now
 }
 
@@ -65,6 +68,7 @@ srv_clonefiles(FileId& fileid) {
 
     FileId r = std::make_shared<RawFileId>(fileid->getContents());
     r->getContents().nref = 1;
+    r->getContents().dir.reset();
     for (auto curr = r->getNext(); curr; curr = curr->getNext()) {
         curr->getContents().nref++;
         if (curr == 0) {
@@ -235,130 +239,247 @@ srv_writectl(Req9 *req, std::function<char*(void*, Msg*)> fn) {
  * for each TRead request, pending_clunk for each TClunk
  * request, and pending_flush for each TFlush request.
  *
- * pending_write queues the data in P<dat> of length P<ndat>
- * to be written to each currently pending fid in P<pending>. If
- * there is a read request pending for a given fid, the data is
- * written immediately. Otherwise, it is written the next time
- * pending_respond is called. Likewise, if there is data
- * queued when pending_respond is called, it is written
- * immediately, otherwise the request is queued.
+ * pending_write appends the data in P<dat> of length P<ndat>
+ * to the event log of P<pending>. The event is copied once and
+ * shared by every fid pushed before the write; each of them
+ * keeps a cursor into the log. If there is a read request
+ * pending for a given fid, the event is written immediately.
+ * Otherwise, it is written the next time pending_respond is
+ * called. Likewise, if there is an event unread when
+ * pending_respond is called, it is written immediately,
+ * otherwise the request is queued. An event longer than the
+ * read count is returned over several reads.
+ *
+ * Events are dropped from the log once every fid has read them.
+ * The unread events of each fid are bounded by P<limits>, and
+ * the whole log by P<logLimits>; what happens to a fid over them
+ * is chosen by P<policy>, see T<LagPolicy>. Both are unbounded
+ * unless set, so that every fid reads every event. P<stats>
+ * returns how often each policy was applied.
  *
  * pending_print and pending_vprint call pending_write
  * after formatting their arguments with V<vsmprint>.
  *
- * The Pending data structure is opaque and should be
- * initialized zeroed before using these functions for the first
- * time.
+ * A default constructed Pending is ready for use.
  *
  * Returns:
  *	pending_clunk returns true if P<pending> has any
  *	more pending Fids.
  */
+static std::string Ehungup("event queue overflow");
 
-void
-pending_respond(Req9 *req) {
+namespace {
+using Answer = std::pair<Req9*, PendingEvent>;
+
+PendingLinkBody*
+subscriber(Req9* req) {
     auto file = req->getFid()->unpackAux<FileId>();
     if (!file->getContents().pending) {
         throw Exception("Given file's contents not marked as pending!");
     }
+    return (PendingLinkBody*)(file->getContents().p);
+}
 
-	auto p = (PendingLink*)(file->getContents().p);
-
-    if (auto& queue = (*p)->getContents().queue; !queue.empty()) {
-        std::string front(queue.front());
-        queue.pop_front();
-        auto buf = new char[front.size()+1];
-        buf[front.size()] = '\0';
-        front.copy(buf, front.size());
-        req->getOFcall().getIO().setData(buf);
-		req->getOFcall().getIO().setSize(front.length() + 1);
-		if(req->getAux().has_value()) {
-            auto req_link = req->unpackAux<RequestLink>();
-            req_link->unlink();
-		}
-		req->respond(nullptr);
-	} else {
-        RequestLink reqLink = std::make_shared<RawRequestLink>();
-        reqLink->setNext((*p)->getContents().pending->req);
-        reqLink->setPrevious(reqLink->getNext()->getPrevious());
-        reqLink->getNext()->setPrevious(reqLink);
-        reqLink->getPrevious()->setNext(reqLink);
-		req->getAux() = reqLink;
-	}
+/* bytes written before the event with sequence number P<seq> */
+uint64_t
+startOf(const Pending& pending, uint64_t seq) noexcept {
+    if (seq - pending.base >= pending.log.size()) {
+        return pending.written;
+    }
+    auto& entry = pending.log[seq - pending.base];
+    return entry.end - entry.event->size();
 }
 
+/* with the lock held: apply the policy to P<link> for its oldest unread event */
 void
-Pending::write(const std::string& dat) {
-    if (dat.empty()) {
+lag(Pending& pending, PendingLinkBody& link) {
+    if (pending.policy == LagPolicy::HangUp) {
+        link.hungup = true;
+        ++pending.counters.hangups;
         return;
     }
-    write(dat.c_str(), dat.length());
+    ++link.cursor;
+    link.offset = 0;
+    ++link.dropped;
+    ++pending.counters.dropped;
+    if (pending.policy == LagPolicy::Coalesce) {
+        ++link.missed;
+    }
 }
-void
-Pending::write(const char *dat, long ndat) {
-	RequestLink req_link;
 
-	if(ndat == 0) {
-		return;
+/* with the lock held: hold P<link> to the limits for each subscriber */
+void
+limit(Pending& pending, PendingLinkBody& link) {
+    auto end = pending.base + pending.log.size();
+    auto entries = pending.limits.entries;
+    auto bytes = pending.limits.bytes;
+    while (!link.hungup && link.cursor < end) {
+        auto unread = end - link.cursor;
+        if ((entries && unread > entries) ||
+                (bytes && unread > 1 && pending.written - startOf(pending, link.cursor) > bytes)) {
+            lag(pending, link);
+        } else {
+            break;
+        }
     }
+}
 
-    if (!this->req->getNext()) {
-        this->req->setNext(this->req);
-        this->req->setPrevious(this->req);
-        this->fids->setPrevious(this->fids);
-        this->fids->setNext(this->fids);
-	}
-    for (PendingLink pp = this->fids->getNext(); pp != this->fids; pp = pp->getNext()) {
-        std::string entry(dat, ndat);
-        pp->getContents().queue.emplace_back(entry);
-	}
+/* with the lock held: pair waiting reads of P<link> with events it has not read yet */
+void
+collect(Pending& pending, PendingLinkBody& link, std::vector<Answer>& out) {
+    auto end = pending.base + pending.log.size();
+    while (!link.reads.empty() && (link.hungup || link.missed || link.cursor < end)) {
+        auto req = link.reads.front();
+        link.reads.pop_front();
+        if (link.hungup) {
+            out.emplace_back(req, nullptr);
+            continue;
+        }
+        if (req->getIFcall().getIO().empty()) {
+            out.emplace_back(req, std::make_shared<const std::string>());
+            continue;
+        }
+        if (link.missed) {
+            out.emplace_back(req, std::make_shared<const std::string>(smprint(link.missed, " events dropped\n")));
+            link.missed = 0;
+            ++pending.counters.coalesced;
+            continue;
+        }
+        auto& event = pending.log[link.cursor - pending.base].event;
+        auto count = std::min<size_t>(req->getIFcall().getIO().size(), event->size() - link.offset);
+        if (count == event->size()) {
+            // the common case: the whole event fits, share it
+            out.emplace_back(req, event);
+        } else {
+            out.emplace_back(req, std::make_shared<const std::string>(*event, link.offset, count));
+        }
+        if ((link.offset += count) >= event->size()) {
+            link.offset = 0;
+            ++link.cursor;
+        }
+    }
+}
 
-    RequestLink reqLink = std::make_shared<RawRequestLink>();
-    reqLink->setNext(reqLink);
-    reqLink->setPrevious(reqLink);
-    if (this->req->getNext() != this->req) {
-        reqLink->setNext(this->req->getNext());
-        reqLink->setPrevious(this->req->getPrevious());
-        this->req->setPrevious(this->req);
-        this->req->setNext(this->req);
-	}
-    reqLink->getPrevious()->setNext(reqLink);
-    reqLink->getNext()->setPrevious(reqLink);
+/* with the lock held: forget the events every fid has read */
+void
+trim(Pending& pending) {
+    auto oldest = pending.base + pending.log.size();
+    for (const auto& link : pending.fids) {
+        if (!link.hungup) {
+            oldest = std::min(oldest, link.cursor);
+        }
+    }
+    for (; pending.base < oldest; ++pending.base) {
+        pending.log.pop_front();
+    }
+}
 
-    for (auto rp = reqLink->getNext(); rp != reqLink; ) {
-        pending_respond(rp->getContents().req);
+/* with the lock held: trim the log, then hold it to its own limits */
+void
+shrink(Pending& pending) {
+    trim(pending);
+    auto entries = pending.logLimits.entries;
+    auto bytes = pending.logLimits.bytes;
+    while ((entries && pending.log.size() > entries) ||
+            (bytes && pending.log.size() > 1 && pending.written - startOf(pending, pending.base) > bytes)) {
+        for (auto& link : pending.fids) {
+            if (!link.hungup && link.cursor == pending.base) {
+                lag(pending, link);
+            }
+        }
+        trim(pending);
     }
 }
 
+/* without the lock: requests may be answered from another thread */
+void
+answer(std::vector<Answer>& answers) {
+    for (auto& [req, event] : answers) {
+        if (!event) {
+            req->respond(Ehungup.c_str());
+            continue;
+        }
+        req->getOFcall().getIO().setData(event);
+        req->getOFcall().getIO().setSize(event->size());
+        req->respond(nullptr);
+    }
+}
+} // end namespace
 
 void
-Pending::pushfid(Fid *fid) {
+pending_respond(Req9 *req) {
+    auto link = subscriber(req);
+    auto& pending = *link->pending;
+    std::vector<Answer> answers;
+    {
+        std::lock_guard<Mutex> lock(pending.lock);
+        link->reads.push_back(req);
+        collect(pending, *link, answers);
+        shrink(pending);
+    }
+    answer(answers);
+}
 
-    if (!this->req->getNext()) {
+void
+Pending::write(const std::string& dat) {
+    if (dat.empty()) {
+        return;
+    }
+    write(dat.c_str(), dat.length());
+}
+void
+Pending::write(const char *dat, long ndat) {
+	if(ndat <= 0) {
+		return;
+    }
+    auto event = std::make_shared<const std::string>(dat, ndat);
+    std::vector<Answer> answers;
+    {
+        std::lock_guard<Mutex> guard(lock);
+        written += event->size();
+        log.push_back(Entry { std::move(event), written });
+        for (auto& link : fids) {
+            limit(*this, link);
+            collect(*this, link, answers);
+        }
+        shrink(*this);
+    }
+    answer(answers);
+}
 
-        RawRequestLink::circularLink(this->req);
-        RawPendingLink::circularLink(this->fids);
-	}
+PendingStats
+Pending::stats() {
+    std::lock_guard<Mutex> guard(lock);
+    auto out = counters;
+    out.subscribers = fids.size();
+    out.entries = log.size();
+    out.bytes = written - startOf(*this, base);
+    return out;
+}
 
+void
+Pending::pushfid(Fid *fid) {
     auto file = fid->unpackAux<FileId>();
-    PendingLink pendLink = std::make_shared<RawPendingLink>();
-    pendLink->getContents().fid = fid;
-    pendLink->getContents().pending = this;
-    pendLink->setNext(this->fids);
-    pendLink->setPrevious(pendLink->getNext()->getPrevious());
-    pendLink->getNext()->setPrevious(pendLink);
-    pendLink->getPrevious()->setNext(pendLink);
+    std::lock_guard<Mutex> guard(lock);
+    auto& link = fids.emplace_back();
+    link.fid = fid;
+    link.pending = this;
+    link.cursor = base + log.size();
+    link.offset = 0;
+    link.dropped = 0;
+    link.missed = 0;
+    link.hungup = false;
     file->getContents().pending = true;
-    file->getContents().p = &pendLink;
+    file->getContents().p = &link;
 }
 
 static void
 _pending_flush(Req9 *req) {
     auto file = req->getFid()->unpackAux<FileId>();
 	if(file->getContents().pending) {
-        if (auto req_link = req->unpackAux<RequestLink>(); req_link) {
-            req_link->unlink();
-        }
+        auto link = (PendingLinkBody*)(file->getContents().p);
+        std::lock_guard<Mutex> lock(link->pending->lock);
+        link->reads.remove(req);
 	}
 }
 
@@ -370,27 +491,24 @@ pending_flush(Req9 *req) {
 
 bool
 pending_clunk(Req9 *req) {
-
+    auto link = subscriber(req);
+    auto& pending = *link->pending;
+    std::list<Req9*> reads;
+    auto more = false;
+    {
+        std::lock_guard<Mutex> lock(pending.lock);
+        reads.swap(link->reads);
+        pending.fids.remove_if([link](const auto& other) { return &other == link; });
+        shrink(pending);
+        more = !pending.fids.empty();
+    }
+    for (auto r : reads) {
+        r->respond("interrupted");
+    }
     auto file = req->getFid()->unpackAux<FileId>();
-    auto pendLink = std::any_cast<PendingLink>(file->getContents().p);
-
-    auto pending = pendLink->getContents().pending;
-    Req9* r = nullptr;
-	for(auto reqLink =pending->req->getNext(); reqLink != pending->req;) {
-        r = reqLink->getContents().req;
-        reqLink = reqLink->getNext();
-        if (r->getFid() == pendLink->getContents().fid) {
-			_pending_flush(r);
-			r->respond("interrupted");
-		}
-	}
-
-    pendLink->unlink();
-
-    pendLink->getContents().queue.clear();
-    auto more = (pendLink->getContents().pending->fids->getNext() == 
-                 pendLink->getContents().pending->fids);
-    r->respond(nullptr);
+    file->getContents().pending = false;
+    file->getContents().p = nullptr;
+    req->respond(nullptr);
 	return more;
 }
 
@@ -420,7 +538,10 @@ pending_clunk(Req9 *req) {
  * directory, taking into account the requested offset, and
  * calls F<respond>. The P<dostat> parameter must be a
  * function which fills the passed S<Stat> pointer based on
- * the contents of the passed FileId.
+ * the contents of the passed FileId. The stats are taken once,
+ * on the first read of the fid, and kept in a T<DirSnapshot>
+ * until the fid is clunked, the directory's qid version
+ * changes, or the fid is read from offset 0 again.
  *
  * srv_verifyfile returns whether a file still exists in the
  * filesystem, and should be used by filesystems that invalidate
@@ -447,6 +568,27 @@ srv_verifyfile(FileId& file, LookupFn lookup) {
 	return ret;
 }
 
+static std::shared_ptr<DirSnapshot>
+snapshotdir(FileId& dir, uint32_t version, LookupFn& lookup, std::function<void(Stat*, FileId&)>& dostat) {
+    auto snap = std::make_shared<DirSnapshot>();
+    snap->version = version;
+	Stat stat;
+    /* each stat, at most 2+65535 bytes, is packed here and then appended */
+    constexpr auto StatMax = 2u + 65535u;
+    Msg msg(new char[StatMax], StatMax, Msg::Mode::Pack);
+	/* Note: The first file is ".", so we skip it. */
+	for(auto file = lookup(dir, "")->getNext(); file; file = file->getNext()) {
+		dostat(&stat, file);
+        msg.setPos(msg.getData());
+        msg.pstat(&stat);
+        snap->offsets.push_back(snap->data.size());
+        snap->data.append(msg.getData(), msg.getPos() - msg.getData());
+        stat.reset();
+	}
+    snap->offsets.push_back(snap->data.size());
+    return snap;
+}
+
 void
 srv_readdir(Req9 *req, LookupFn lookup, std::function<void(Stat*, FileId&)> dostat) {
 	Stat stat;
@@ -457,30 +599,28 @@ srv_readdir(Req9 *req, LookupFn lookup, std::function<void(Stat*, FileId&)> dost
 	if(size > req->getFid()->getIoUnit()) {
 		size = req->getFid()->getIoUnit();
     }
-    auto buf = new char[size];
-    Msg msg(buf, size, Msg::Mode::Pack);
-
-	file = lookup(file, "");
-	auto tfile = file;
-	/* Note: The first file is ".", so we skip it. */
-	uint64_t offset = 0;
-	for(file=file->getNext(); file; file=file->getNext()) {
-		dostat(&stat, file);
-        ulong n = stat.size();
-		if(offset >= req->getIFcall().getIO().getOffset()) {
-			if(size < n)
-				break;
-            msg.pstat(&stat);
-			size -= n;
-		}
-		offset += n;
-	}
-	while((file = tfile)) {
-		tfile=tfile->getNext();
-		srv_freefile(file);
-	}
-	req->getOFcall().getIO().setSize(msg.getPos() - msg.getData());
-    req->getOFcall().getIO().setData(msg.getData());
+    auto offset = req->getIFcall().getIO().getOffset();
+    dostat(&stat, file);
+    auto& snap = file->getContents().dir;
+    if (!snap || offset == 0 || snap->version != stat.getQid().getVersion()) {
+        snap = snapshotdir(file, stat.getQid().getVersion(), lookup, dostat);
+    }
+    auto& offsets = snap->offsets;
+    /* sequential reads resume where the last one stopped */
+    auto first = snap->next;
+    if (first >= offsets.size() || offsets[first] != offset) {
+        auto found = std::lower_bound(offsets.begin(), offsets.end(), offset);
+        if (found == offsets.end() || *found != offset) {
+            req->respond(Ebadoffset);
+            return;
+        }
+        first = found - offsets.begin();
+    }
+    auto last = std::upper_bound(offsets.begin() + first, offsets.end(), offsets[first] + size) - offsets.begin() - 1;
+    snap->next = last;
+    auto count = offsets[last] - offsets[first];
+	req->getOFcall().getIO().setSize(count);
+    req->getOFcall().getIO().setData(snap->data.substr(offsets[first], count));
     req->respond(nullptr);
 }
 
@@ -492,21 +632,21 @@ srv_walkandclone(Req9 *req, LookupFn lookup) {
     auto fid = req->getFid()->unpackAux<FileId>();
 	auto file = srv_clonefiles(fid);
 	for(i=0; i < req->getIFcall().getTwalk().size(); i++) {
-        if (req->getIFcall().getTwalk().getWname()[i] == "..") {
+        if (req->getIFcall().getTwalk().getWname(i) == "..") {
 			if(file->hasNext()) {
 				tfile = file;
 				file = file->getNext();
 				srv_freefile(tfile);
 			}
 		}else{
-			tfile = lookup(file, req->getIFcall().getTwalk().getWname()[i]);
+			tfile = lookup(file, std::string(req->getIFcall().getTwalk().getWname(i)));
 			if(!tfile)
 				break;
             if (tfile->hasNext()) {
 			    //assert(!tfile->hasNext());
                 throw Exception("tfile has next!");
             }
-            if (req->getIFcall().getTwalk().getWname()[i] != ".") {
+            if (req->getIFcall().getTwalk().getWname(i) != ".") {
 				tfile->setNext(file);
 				file = tfile;
 			}
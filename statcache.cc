@@ -0,0 +1,138 @@
+/* C++ Implementation copyright (c)2019 Joshua Scoggins
+ * See LICENSE file for license details.
+ */
+#include "statcache.h"
+#include "timer.h"
+#include "util.h"
+
+
+namespace jyq {
+std::string
+StatCache::key(const std::string& path) {
+    std::string result;
+    for (const auto& elem : tokenize(path, '/')) {
+        result += '/';
+        result += elem;
+    }
+    return result.empty() ? "/" : result;
+}
+
+std::shared_ptr<Stat>
+StatCache::get(const std::string& path) {
+    std::lock_guard<Mutex> lock(_lock);
+    auto it = _entries.find(key(path));
+    if (it == _entries.end()) {
+        _misses.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    if (it->second.expires <= msec()) {
+        erase(it);
+        _misses.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    _hits.fetch_add(1, std::memory_order_relaxed);
+    return std::make_shared<Stat>(it->second.stat);
+}
+
+void
+StatCache::put(const std::string& path, const Stat& stat) {
+    auto ttl = getTtl();
+    if (ttl == 0) {
+        return;
+    }
+    auto now = msec();
+    auto k = key(path);
+    std::lock_guard<Mutex> lock(_lock);
+    if (auto it = _entries.find(k); it != _entries.end()) {
+        erase(it);
+    } else if (_entries.size() >= _limit) {
+        sweep(now);
+    }
+    _byQid[stat.getQid().getPath()].insert(k);
+    _entries.emplace(std::move(k), Entry { stat, now + ttl });
+}
+
+void
+StatCache::revalidate(const std::string& path, const Qid& qid) {
+    std::lock_guard<Mutex> lock(_lock);
+    if (auto it = _entries.find(key(path)); it != _entries.end()) {
+        if (auto& q = it->second.stat.getQid(); q.getPath() != qid.getPath() || q.getVersion() != qid.getVersion()) {
+            erase(it);
+        }
+    }
+}
+
+void
+StatCache::invalidate(const std::string& path) {
+    std::lock_guard<Mutex> lock(_lock);
+    if (auto it = _entries.find(key(path)); it != _entries.end()) {
+        erase(it);
+    }
+}
+
+void
+StatCache::invalidate(uint64_t qidpath) {
+    std::lock_guard<Mutex> lock(_lock);
+    auto it = _byQid.find(qidpath);
+    if (it == _byQid.end()) {
+        return;
+    }
+    for (const auto& path : it->second) {
+        _entries.erase(path);
+    }
+    _byQid.erase(it);
+}
+
+void
+StatCache::clear() {
+    std::lock_guard<Mutex> lock(_lock);
+    _entries.clear();
+    _byQid.clear();
+}
+
+void
+StatCache::setTtl(uint64_t ttl) {
+    _ttl.store(ttl, std::memory_order_relaxed);
+    if (ttl == 0) {
+        clear();
+    }
+}
+
+StatCache::Stats
+StatCache::stats() {
+    std::lock_guard<Mutex> lock(_lock);
+    return Stats {
+        _hits.load(std::memory_order_relaxed),
+        _misses.load(std::memory_order_relaxed),
+        _entries.size(),
+    };
+}
+
+void
+StatCache::erase(std::map<std::string, Entry>::iterator it) {
+    if (auto q = _byQid.find(it->second.stat.getQid().getPath()); q != _byQid.end()) {
+        q->second.erase(it->first);
+        if (q->second.empty()) {
+            _byQid.erase(q);
+        }
+    }
+    _entries.erase(it);
+}
+
+void
+StatCache::sweep(uint64_t now) {
+    auto before = _entries.size();
+    for (auto it = _entries.begin(); it != _entries.end();) {
+        if (it->second.expires <= now) {
+            erase(it++);
+        } else {
+            ++it;
+        }
+    }
+    if (_entries.size() == before) {
+        _entries.clear();
+        _byQid.clear();
+    }
+}
+
+} // end namespace jyq
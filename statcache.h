@@ -0,0 +1,81 @@
+#ifndef LIBJYQ_STATCACHE_H__
+#define LIBJYQ_STATCACHE_H__
+/* C++ Implementation copyright (c)2019 Joshua Scoggins
+ * See LICENSE file for license details.
+ */
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include "types.h"
+#include "qid.h"
+#include "stat.h"
+
+
+namespace jyq {
+    /**
+     * Type: StatCache
+     *
+     * The results of stat kept by a T<Client>, keyed by path, each for
+     * P<ttl> milliseconds after it was stored. Entries remember the qid
+     * they describe: a walk which finds another qid at the path drops
+     * its entry, and changes made through the client drop every entry
+     * of the file by qid path, whatever path it was stated under.
+     *
+     * Paths are compared after dropping empty components, so "a//b/"
+     * and "/a/b" name the same entry. Once limit entries are held,
+     * storing another first drops the expired ones, and all of them if
+     * none had expired. All members may be called from any thread.
+     *
+     * See also:
+     *	F<setStatCache>, F<stat>, F<readDir>
+     */
+    class StatCache {
+        public:
+            struct Stats {
+                uint64_t hits;
+                uint64_t misses;
+                size_t entries;
+            };
+        public:
+            explicit StatCache(uint64_t ttl, size_t limit = 4096) : _ttl(ttl), _limit(limit) { }
+            StatCache(const StatCache&) = delete;
+            StatCache& operator=(const StatCache&) = delete;
+            /**
+             * @return a copy of the entry for path, or nullptr if it is missing or expired
+             */
+            std::shared_ptr<Stat> get(const std::string& path);
+            void put(const std::string& path, const Stat& stat);
+            /**
+             * Drop the entry for path unless it describes qid.
+             */
+            void revalidate(const std::string& path, const Qid& qid);
+            void invalidate(const std::string& path);
+            void invalidate(uint64_t qidpath);
+            void clear();
+            void setTtl(uint64_t ttl);
+            uint64_t getTtl() const noexcept { return _ttl.load(std::memory_order_relaxed); }
+            Stats stats();
+            static std::string key(const std::string& path);
+        private:
+            struct Entry {
+                Stat stat;
+                uint64_t expires;
+            };
+            /* with the lock held */
+            void erase(std::map<std::string, Entry>::iterator it);
+            void sweep(uint64_t now);
+        private:
+            Mutex _lock JYQ_LOCK_NAME("StatCache::_lock");
+            std::atomic<uint64_t> _ttl;
+            size_t _limit;
+            std::map<std::string, Entry> _entries;
+            std::map<uint64_t, std::set<std::string>> _byQid;
+            std::atomic<uint64_t> _hits { 0 };
+            std::atomic<uint64_t> _misses { 0 };
+    };
+} // end namespace jyq
+
+#endif // end LIBJYQ_STATCACHE_H__
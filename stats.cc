@@ -0,0 +1,196 @@
+/* C++ Implementation copyright (c)2019 Joshua Scoggins
+ * See LICENSE file for license details.
+ */
+#include <iomanip>
+#include "stats.h"
+#include "Conn9.h"
+
+
+namespace jyq {
+const char*
+typeName(FType type) noexcept {
+    switch (type) {
+        case FType::TVersion: return "Tversion";
+        case FType::RVersion: return "Rversion";
+        case FType::TAuth: return "Tauth";
+        case FType::RAuth: return "Rauth";
+        case FType::TAttach: return "Tattach";
+        case FType::RAttach: return "Rattach";
+        case FType::TError: return "Terror";
+        case FType::RError: return "Rerror";
+        case FType::TFlush: return "Tflush";
+        case FType::RFlush: return "Rflush";
+        case FType::TWalk: return "Twalk";
+        case FType::RWalk: return "Rwalk";
+        case FType::TOpen: return "Topen";
+        case FType::ROpen: return "Ropen";
+        case FType::TCreate: return "Tcreate";
+        case FType::RCreate: return "Rcreate";
+        case FType::TRead: return "Tread";
+        case FType::RRead: return "Rread";
+        case FType::TWrite: return "Twrite";
+        case FType::RWrite: return "Rwrite";
+        case FType::TClunk: return "Tclunk";
+        case FType::RClunk: return "Rclunk";
+        case FType::TRemove: return "Tremove";
+        case FType::RRemove: return "Rremove";
+        case FType::TStat: return "Tstat";
+        case FType::RStat: return "Rstat";
+        case FType::TWStat: return "Twstat";
+        case FType::RWStat: return "Rwstat";
+        default: return "unknown";
+    }
+}
+
+void
+LatencyHistogram::record(uint64_t ns) noexcept {
+    auto bucket = ns ? jyq::min<uint>(63 - __builtin_clzll(ns), Buckets - 1) : 0u;
+    _counts[bucket].fetch_add(1, std::memory_order_relaxed);
+    _sum.fetch_add(ns, std::memory_order_relaxed);
+    for (auto current = _max.load(std::memory_order_relaxed);
+            current < ns && !_max.compare_exchange_weak(current, ns, std::memory_order_relaxed);) {
+        // retry until ns is stored or somebody stored a larger value
+    }
+}
+
+LatencyHistogram::Counts
+LatencyHistogram::getCounts() const noexcept {
+    Counts out;
+    for (auto i = 0u; i < Buckets; ++i) {
+        out[i] = _counts[i].load(std::memory_order_relaxed);
+    }
+    return out;
+}
+
+uint64_t
+StatsSnapshot::Op::quantile(double q) const noexcept {
+    uint64_t total = 0;
+    for (auto c : latency) {
+        total += c;
+    }
+    if (total == 0) {
+        return 0;
+    }
+    auto wanted = uint64_t(q * double(total));
+    uint64_t seen = 0;
+    for (auto i = 0u; i < latency.size(); ++i) {
+        if (seen += latency[i]; seen > wanted) {
+            return jyq::min(uint64_t(1) << (i + 1), latencyMax);
+        }
+    }
+    return latencyMax;
+}
+
+ServerStats::Op*
+ServerStats::slot(FType request) noexcept {
+    auto type = uint8_t(request);
+    if (type < uint8_t(FType::TVersion) || type > uint8_t(FType::RWStat)) {
+        return nullptr;
+    }
+    return &_ops[(type - uint8_t(FType::TVersion)) / 2];
+}
+
+void
+ServerStats::received(FType type, uint bytes) noexcept {
+    if (auto op = slot(type); op) {
+        op->received.fetch_add(1, std::memory_order_relaxed);
+        op->bytesIn.fetch_add(bytes, std::memory_order_relaxed);
+    }
+}
+
+void
+ServerStats::responded(FType request, uint bytes, uint64_t latency) noexcept {
+    if (auto op = slot(request); op) {
+        op->responded.fetch_add(1, std::memory_order_relaxed);
+        op->bytesOut.fetch_add(bytes, std::memory_order_relaxed);
+        op->latency.record(latency);
+    }
+}
+
+void
+ServerStats::failed(const char* ename) {
+    Lock lock(_lock);
+    ++_errors[ename];
+}
+
+void
+ServerStats::track(std::shared_ptr<Conn9> conn, int fd) {
+    Lock lock(_lock);
+    _conns.remove_if([](auto& c) { return c.conn.expired(); });
+    _conns.push_back(Tracked { conn, fd });
+}
+
+/**
+ * Function: ServerStats::snapshot
+ *
+ * Copies out the counters. Operations that were never received are
+ * left out, as are connections which have gone away.
+ */
+StatsSnapshot
+ServerStats::snapshot() {
+    StatsSnapshot out;
+    for (auto i = 0u; i < Slots; ++i) {
+        auto& op = _ops[i];
+        if (auto received = op.received.load(std::memory_order_relaxed); received) {
+            out.ops.push_back(StatsSnapshot::Op {
+                        FType(uint8_t(FType::TVersion) + 2 * i),
+                        received,
+                        op.bytesIn.load(std::memory_order_relaxed),
+                        op.responded.load(std::memory_order_relaxed),
+                        op.bytesOut.load(std::memory_order_relaxed),
+                        op.latency.getCounts(),
+                        op.latency.getSum(),
+                        op.latency.getMax(),
+                    });
+        }
+    }
+    Lock lock(_lock);
+    out.errors = _errors;
+    for (auto it = _conns.begin(); it != _conns.end();) {
+        if (auto conn = it->conn.lock(); conn) {
+            out.connections.push_back(StatsSnapshot::Connection { it->fd, conn->getTagMap().size(), conn->getFidMap().size() });
+            ++it;
+        } else {
+            it = _conns.erase(it);
+        }
+    }
+    return out;
+}
+
+/**
+ * Function: operator<<
+ *
+ * Writes a snapshot as plain text, one operation, connection or
+ * error per line, with latencies in microseconds. This is the format
+ * a read handler would serve for a statistics file.
+ */
+std::ostream&
+operator<<(std::ostream& os, const StatsSnapshot& stats) {
+    os << std::left << std::setw(10) << "op"
+       << std::right << std::setw(10) << "count"
+       << std::setw(12) << "bytes-in"
+       << std::setw(12) << "bytes-out"
+       << std::setw(10) << "mean-us"
+       << std::setw(10) << "p50-us"
+       << std::setw(10) << "p99-us"
+       << std::setw(10) << "max-us" << std::endl;
+    for (const auto& op : stats.ops) {
+        os << std::left << std::setw(10) << typeName(op.type)
+           << std::right << std::setw(10) << op.received
+           << std::setw(12) << op.bytesIn
+           << std::setw(12) << op.bytesOut
+           << std::setw(10) << op.mean() / 1000
+           << std::setw(10) << op.quantile(0.5) / 1000
+           << std::setw(10) << op.quantile(0.99) / 1000
+           << std::setw(10) << op.latencyMax / 1000 << std::endl;
+    }
+    for (const auto& conn : stats.connections) {
+        os << "conn " << conn.fd << ": " << conn.inflight << " in flight, " << conn.fids << " fids" << std::endl;
+    }
+    for (const auto& [ename, count] : stats.errors) {
+        os << "error \"" << ename << "\": " << count << std::endl;
+    }
+    return os;
+}
+
+} // end namespace jyq
@@ -0,0 +1,123 @@
+#ifndef LIBJYQ_STATS_H__
+#define LIBJYQ_STATS_H__
+/* C++ Implementation copyright (c)2019 Joshua Scoggins
+ * See LICENSE file for license details.
+ */
+
+#include <array>
+#include <atomic>
+#include <list>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "types.h"
+
+
+namespace jyq {
+    struct Conn9;
+    /**
+     * Function: typeName
+     *
+     * Returns the name of a 9P message type, such as "Twalk", or
+     * "unknown" for values outside of the protocol.
+     */
+    const char* typeName(FType type) noexcept;
+    /**
+     * Type: LatencyHistogram
+     *
+     * Counts samples, in nanoseconds, in power of two buckets: bucket
+     * i holds the samples in [2^i, 2^(i+1)). Recording is a handful of
+     * relaxed atomic increments and may happen from any thread.
+     */
+    class LatencyHistogram {
+        public:
+            static constexpr auto Buckets = 40u;
+            using Counts = std::array<uint64_t, Buckets>;
+            void record(uint64_t ns) noexcept;
+            Counts getCounts() const noexcept;
+            uint64_t getSum() const noexcept { return _sum.load(std::memory_order_relaxed); }
+            uint64_t getMax() const noexcept { return _max.load(std::memory_order_relaxed); }
+        private:
+            std::array<std::atomic<uint64_t>, Buckets> _counts { };
+            std::atomic<uint64_t> _sum { 0 };
+            std::atomic<uint64_t> _max { 0 };
+    };
+    /**
+     * Type: StatsSnapshot
+     *
+     * A copy of the counters of a T<ServerStats>. Operations are listed
+     * by their request type: received and bytesIn describe the T
+     * messages, responded and bytesOut the replies, errors included,
+     * and latency the time from receipt in handleFcall to respond.
+     */
+    struct StatsSnapshot {
+        struct Op {
+            FType type;
+            uint64_t received;
+            uint64_t bytesIn;
+            uint64_t responded;
+            uint64_t bytesOut;
+            LatencyHistogram::Counts latency;
+            uint64_t latencySum;
+            uint64_t latencyMax;
+            /**
+             * @return the upper bound, in nanoseconds, of the bucket holding the q quantile
+             */
+            uint64_t quantile(double q) const noexcept;
+            uint64_t mean() const noexcept { return responded ? latencySum / responded : 0; }
+        };
+        struct Connection {
+            int fd;
+            size_t inflight;
+            size_t fids;
+        };
+        std::vector<Op> ops;
+        std::vector<Connection> connections;
+        std::map<std::string, uint64_t> errors;
+    };
+    std::ostream& operator<<(std::ostream& os, const StatsSnapshot& stats);
+    /**
+     * Type: ServerStats
+     *
+     * Message, byte, latency and error counters for a server. Point
+     * the P<stats> member of a T<Srv9> at an instance to have them
+     * maintained; snapshot copies them out, together with the tags in
+     * flight and fids open on every connection that is still alive.
+     *
+     * See also:
+     *	T<Srv9>, T<StatsSnapshot>
+     */
+    class ServerStats {
+        public:
+            void received(FType type, uint bytes) noexcept;
+            void responded(FType request, uint bytes, uint64_t latency) noexcept;
+            void failed(const char* ename);
+            void track(std::shared_ptr<Conn9> conn, int fd);
+            StatsSnapshot snapshot();
+        private:
+            /* one slot per request type, from TVersion to TWStat */
+            static constexpr auto Slots = (uint8_t(FType::TWStat) - uint8_t(FType::TVersion)) / 2 + 1;
+            struct Op {
+                std::atomic<uint64_t> received { 0 };
+                std::atomic<uint64_t> bytesIn { 0 };
+                std::atomic<uint64_t> responded { 0 };
+                std::atomic<uint64_t> bytesOut { 0 };
+                LatencyHistogram latency;
+            };
+            Op* slot(FType request) noexcept;
+        private:
+            std::array<Op, Slots> _ops;
+            Mutex _lock JYQ_LOCK_NAME("ServerStats::_lock");
+            std::map<std::string, uint64_t> _errors;
+            struct Tracked {
+                std::weak_ptr<Conn9> conn;
+                /* recorded up front, as the Conn behind it goes away on another thread */
+                int fd;
+            };
+            std::list<Tracked> _conns;
+    };
+} // end namespace jyq
+
+#endif // end LIBJYQ_STATS_H__
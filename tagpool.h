@@ -0,0 +1,152 @@
+#ifndef LIBJYQ_TAGPOOL_H__
+#define LIBJYQ_TAGPOOL_H__
+/* C++ Implementation copyright (c)2019 Joshua Scoggins
+ * See LICENSE file for license details.
+ */
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include "types.h"
+
+
+namespace jyq {
+    /**
+     * Type: TagPool
+     *
+     * Hands out the tags of a client connection, each with a slot to
+     * hold the value waiting on it. Free tags are kept on a lock-free
+     * stack, so get and put are a single compare and swap. The top of
+     * the stack is stored together with a count of the changes made to
+     * it, so that a thread which read a stale top cannot swap it back
+     * in after other threads popped and pushed the same tag (the ABA
+     * problem).
+     *
+     * As in T<TagTable>, slots live in fixed size pages which are
+     * allocated as the number of tags in use grows and are kept for the
+     * life of the pool, so reading a slot takes no lock and a slot
+     * never moves. At most limit tags are handed out; get fails once
+     * all of them are in use.
+     *
+     * See also:
+     *	T<Client>, T<TagTable>
+     */
+    template<typename V>
+    class TagPool {
+        public:
+            static constexpr auto PageBits = 6u;
+            static constexpr auto PageSize = 1u << PageBits;
+            static constexpr auto PageCount = (1u << 16) >> PageBits;
+            static constexpr auto Empty = ~uint32_t(0);
+            struct Slot {
+                std::atomic<uint32_t> next { Empty };
+                V value { };
+            };
+            using Page = std::array<Slot, PageSize>;
+        public:
+            explicit TagPool(uint32_t limit = 1u << 16) : _limit(std::min(limit, PageCount * PageSize)) { }
+            ~TagPool() {
+                for (auto& page : _pages) {
+                    delete page.load(std::memory_order_relaxed);
+                }
+            }
+            TagPool(const TagPool&) = delete;
+            TagPool(TagPool&&) = delete;
+            TagPool& operator=(const TagPool&) = delete;
+            TagPool& operator=(TagPool&&) = delete;
+            /**
+             * Forget every tag and hand out at most limit of them from
+             * now on. Only to be called while no tag is in use.
+             */
+            void reset(uint32_t limit) noexcept {
+                _limit = std::min(limit, PageCount * PageSize);
+                _grown.store(0, std::memory_order_relaxed);
+                _count.store(0, std::memory_order_relaxed);
+                _head.store(pack(Empty, 0), std::memory_order_release);
+            }
+            /**
+             * Take a free tag.
+             * @return false if all limit tags are in use
+             */
+            bool get(uint32_t& tag) {
+                for (auto head = _head.load(std::memory_order_acquire); index(head) != Empty;) {
+                    auto next = slot(index(head)).next.load(std::memory_order_relaxed);
+                    if (_head.compare_exchange_weak(head, pack(next, head), std::memory_order_acquire, std::memory_order_acquire)) {
+                        tag = index(head);
+                        _count.fetch_add(1, std::memory_order_relaxed);
+                        return true;
+                    }
+                }
+                return grow(tag);
+            }
+            void put(uint32_t tag) noexcept {
+                push(tag, tag);
+                _count.fetch_sub(1, std::memory_order_relaxed);
+            }
+            /**
+             * @return the slot of tag, or nullptr if tag was never handed out
+             */
+            V* find(uint32_t tag) noexcept {
+                if (tag >= _limit) {
+                    return nullptr;
+                }
+                if (auto page = _pages[tag >> PageBits].load(std::memory_order_acquire); page) {
+                    return &(*page)[tag & (PageSize - 1)].value;
+                }
+                return nullptr;
+            }
+            V& operator[](uint32_t tag) noexcept { return slot(tag).value; }
+            size_t size() const noexcept { return _count.load(std::memory_order_relaxed); }
+            bool empty() const noexcept { return size() == 0; }
+            uint32_t limit() const noexcept { return _limit; }
+        private:
+            static uint32_t index(uint64_t head) noexcept { return uint32_t(head); }
+            /* the new top, stamped with one more change than the old one */
+            static uint64_t pack(uint32_t top, uint64_t old) noexcept {
+                return (((old >> 32) + 1) << 32) | top;
+            }
+            Slot& slot(uint32_t tag) noexcept {
+                return (*_pages[tag >> PageBits].load(std::memory_order_acquire))[tag & (PageSize - 1)];
+            }
+            /* push the chain first..last, already linked through next */
+            void push(uint32_t first, uint32_t last) noexcept {
+                auto head = _head.load(std::memory_order_relaxed);
+                do {
+                    slot(last).next.store(index(head), std::memory_order_relaxed);
+                } while (!_head.compare_exchange_weak(head, pack(first, head), std::memory_order_release, std::memory_order_relaxed));
+            }
+            /* the stack is empty: take the first tag of the next page and free the rest of it */
+            bool grow(uint32_t& tag) {
+                auto grown = _grown.load(std::memory_order_relaxed);
+                do {
+                    if (grown * PageSize >= _limit) {
+                        return false;
+                    }
+                } while (!_grown.compare_exchange_weak(grown, grown + 1, std::memory_order_relaxed));
+                auto& entry = _pages[grown];
+                if (!entry.load(std::memory_order_acquire)) {
+                    entry.store(new Page(), std::memory_order_release);
+                }
+                auto first = grown * PageSize;
+                auto last = std::min<uint32_t>(first + PageSize, _limit) - 1;
+                for (auto i = first + 1; i < last; ++i) {
+                    slot(i).next.store(i + 1, std::memory_order_relaxed);
+                }
+                if (first < last) {
+                    push(first + 1, last);
+                }
+                tag = first;
+                _count.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        private:
+            std::array<std::atomic<Page*>, PageCount> _pages {};
+            alignas(64) std::atomic<uint64_t> _head { pack(Empty, 0) };
+            std::atomic<uint32_t> _grown { 0 };
+            std::atomic<size_t> _count { 0 };
+            uint32_t _limit;
+    };
+
+} // end namespace jyq
+
+#endif // end LIBJYQ_TAGPOOL_H__
@@ -0,0 +1,150 @@
+#ifndef LIBJYQ_TAGTABLE_H__
+#define LIBJYQ_TAGTABLE_H__
+/* C++ Implementation copyright (c)2019 Joshua Scoggins
+ * See LICENSE file for license details.
+ */
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <optional>
+#include <utility>
+#include "types.h"
+
+
+namespace jyq {
+    /**
+     * Type: TagTable
+     *
+     * A direct-indexed table of in-flight requests keyed by their 16 bit
+     * tag. Slots live in fixed size pages which are allocated the first
+     * time a tag in their range is used and are kept for the life of the
+     * table, so inserting and removing a request never allocates and a
+     * slot never moves. Lookups take no lock.
+     *
+     * Every slot carries its own state word. emplace moves a slot from
+     * Free to InFlight, and complete moves it from InFlight to
+     * Completing with a single compare and swap, so that when several
+     * threads race to finish the same request exactly one of them wins.
+     * erase completes the slot if needed, destroys the value and hands
+     * the slot back.
+     *
+     * See also:
+     *	T<Conn9>, T<Req9>
+     */
+    template<typename V>
+    class TagTable {
+        public:
+            enum class State : uint8_t {
+                Free,
+                Claimed, /* value under construction */
+                InFlight,
+                Completing,
+            };
+            static constexpr auto PageBits = 6u;
+            static constexpr auto PageSize = 1u << PageBits;
+            static constexpr auto PageCount = (1u << 16) >> PageBits;
+            struct Slot {
+                std::atomic<State> state { State::Free };
+                std::optional<V> value;
+            };
+            using Page = std::array<Slot, PageSize>;
+        public:
+            TagTable() = default;
+            ~TagTable() {
+                for (auto& page : _pages) {
+                    delete page.load(std::memory_order_relaxed);
+                }
+            }
+            TagTable(const TagTable&) = delete;
+            TagTable(TagTable&&) = delete;
+            TagTable& operator=(const TagTable&) = delete;
+            TagTable& operator=(TagTable&&) = delete;
+            /**
+             * Construct a value in the slot for tag.
+             * @return the value and true, or the value already using the tag and false
+             */
+            template<typename ... Args>
+            std::pair<V*, bool> emplace(uint16_t tag, Args&& ... args) {
+                auto& s = acquireSlot(tag);
+                if (auto expected = State::Free; !s.state.compare_exchange_strong(expected, State::Claimed, std::memory_order_acquire)) {
+                    return std::make_pair(get(tag), false);
+                }
+                s.value.emplace(std::forward<Args>(args)...);
+                s.state.store(State::InFlight, std::memory_order_release);
+                _count.fetch_add(1, std::memory_order_relaxed);
+                return std::make_pair(&s.value.value(), true);
+            }
+            V* get(uint16_t tag) noexcept {
+                if (auto s = findSlot(tag); s && s->state.load(std::memory_order_acquire) == State::InFlight) {
+                    return &s->value.value();
+                }
+                return nullptr;
+            }
+            /**
+             * Claim the right to finish the request using tag.
+             * @return true for exactly one caller while the tag is in flight
+             */
+            bool complete(uint16_t tag) noexcept {
+                if (auto s = findSlot(tag); s) {
+                    auto expected = State::InFlight;
+                    return s->state.compare_exchange_strong(expected, State::Completing, std::memory_order_acq_rel);
+                }
+                return false;
+            }
+            bool erase(uint16_t tag) {
+                auto s = findSlot(tag);
+                if (!s) {
+                    return false;
+                }
+                if (auto current = s->state.load(std::memory_order_acquire); current != State::Completing && !complete(tag)) {
+                    return false;
+                }
+                s->value.reset();
+                s->state.store(State::Free, std::memory_order_release);
+                _count.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+            size_t size() const noexcept { return _count.load(std::memory_order_relaxed); }
+            bool empty() const noexcept { return size() == 0; }
+            template<typename T>
+            void exec(std::function<void(T, V&)> fn, T context) {
+                for (auto& entry : _pages) {
+                    if (auto page = entry.load(std::memory_order_acquire); page) {
+                        for (auto& s : *page) {
+                            if (s.state.load(std::memory_order_acquire) == State::InFlight) {
+                                fn(context, s.value.value());
+                            }
+                        }
+                    }
+                }
+            }
+        private:
+            Slot* findSlot(uint16_t tag) noexcept {
+                if (auto page = _pages[tag >> PageBits].load(std::memory_order_acquire); page) {
+                    return &(*page)[tag & (PageSize - 1)];
+                }
+                return nullptr;
+            }
+            Slot& acquireSlot(uint16_t tag) {
+                auto& entry = _pages[tag >> PageBits];
+                auto page = entry.load(std::memory_order_acquire);
+                if (!page) {
+                    auto fresh = new Page();
+                    if (entry.compare_exchange_strong(page, fresh, std::memory_order_acq_rel)) {
+                        page = fresh;
+                    } else {
+                        // somebody else installed the page first
+                        delete fresh;
+                    }
+                }
+                return (*page)[tag & (PageSize - 1)];
+            }
+        private:
+            std::array<std::atomic<Page*>, PageCount> _pages {};
+            std::atomic<size_t> _count { 0 };
+    };
+
+} // end namespace jyq
+
+#endif // end LIBJYQ_TAGTABLE_H__
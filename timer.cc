@@ -4,10 +4,12 @@
  */
 #include <cstdlib>
 #include <sys/time.h>
+#include <ctime>
 #include "Msg.h"
 #include "jyq.h"
 #include "timer.h"
 #include "Server.h"
+#include "probes.h"
 
 
 namespace jyq {
@@ -24,6 +26,20 @@ msec() {
 	return (uint64_t)tv.tv_sec*1000 + (uint64_t)tv.tv_usec/1000;
 }
 
+/**
+ * Function: nsec
+ *
+ * Returns a monotonic timestamp in nanoseconds, for measuring
+ * intervals. It is unrelated to the time of day.
+ */
+uint64_t
+nsec() {
+	timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000000 + (uint64_t)ts.tv_nsec;
+}
+
 /**
  * Function: settimer
  *
@@ -129,6 +145,7 @@ Server::nexttimer() {
 		_timer = t->getLink();
 
         locker.unlock();
+        JYQ_PROBE(timer__fire, t->getId(), time - t->getMsec());
         t->call(t->getId(), t->aux);
         delete t;
         locker.lock();
@@ -36,6 +36,7 @@ namespace jyq {
             std::any	aux;
     };
     uint64_t msec();
+    uint64_t nsec();
 } // end namespace jyq
 
 #endif // end LIBJYQ_TIMER_H__
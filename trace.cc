@@ -0,0 +1,147 @@
+/* C++ Implementation copyright (c)2019 Joshua Scoggins
+ * See LICENSE file for license details.
+ */
+#include <algorithm>
+#include <cstring>
+#include "trace.h"
+#include "stats.h"
+#include "timer.h"
+
+
+namespace jyq {
+Tracer Tracer::_global;
+
+thread_local Tracer::Ring* Tracer::_local = nullptr;
+
+/* file header: magic, format version and record count */
+static constexpr char TraceMagic[8] = { 'J', 'Y', 'Q', 'T', 'R', 'A', 'C', 'E' };
+static constexpr uint32_t TraceFormat = 1;
+
+const char*
+eventName(TraceEvent event) noexcept {
+    switch (event) {
+        case TraceEvent::Received: return "received";
+        case TraceEvent::Dispatched: return "dispatched";
+        case TraceEvent::HandlerStart: return "handler start";
+        case TraceEvent::HandlerEnd: return "handler end";
+        case TraceEvent::Responded: return "responded";
+        case TraceEvent::Sent: return "sent";
+        default: return "unknown";
+    }
+}
+
+Tracer::Ring&
+Tracer::local() {
+    if (!_local) {
+        Lock lock(_lock);
+        _rings.emplace_back(std::make_shared<Ring>(_rings.size()));
+        _local = _rings.back().get();
+    }
+    return *_local;
+}
+
+/**
+ * Function: Tracer::record
+ *
+ * Only the owning thread writes to a ring. The sequence of a slot is
+ * cleared before its record is overwritten and set again afterwards,
+ * so that snapshot can tell a torn copy from a complete one.
+ */
+void
+Tracer::record(TraceEvent event, FType type, uint16_t tag, uint32_t fid, uint32_t bytes) noexcept {
+    auto& ring = local();
+    auto index = ring.head.load(std::memory_order_relaxed);
+    auto& slot = ring.slots[index % RingSize];
+    slot.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.record = TraceRecord { nsec(), ring.thread, fid, bytes, tag, uint8_t(type), uint8_t(event) };
+    slot.sequence.store(index + 1, std::memory_order_release);
+    ring.head.store(index + 1, std::memory_order_release);
+}
+
+std::vector<TraceRecord>
+Tracer::snapshot() {
+    std::vector<std::shared_ptr<Ring>> rings;
+    {
+        Lock lock(_lock);
+        rings = _rings;
+    }
+    std::vector<TraceRecord> out;
+    for (auto& ring : rings) {
+        auto head = ring->head.load(std::memory_order_acquire);
+        for (auto index = head > RingSize ? head - RingSize : 0; index < head; ++index) {
+            auto& slot = ring->slots[index % RingSize];
+            auto before = slot.sequence.load(std::memory_order_acquire);
+            auto copy = slot.record;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (auto after = slot.sequence.load(std::memory_order_relaxed); before == index + 1 && after == before) {
+                out.push_back(copy);
+            }
+        }
+    }
+    std::stable_sort(out.begin(), out.end(), [](const auto& a, const auto& b) { return a.time < b.time; });
+    return out;
+}
+
+void
+Tracer::save(std::ostream& os) {
+    auto records = snapshot();
+    uint32_t count = records.size();
+    os.write(TraceMagic, sizeof(TraceMagic));
+    os.write(reinterpret_cast<const char*>(&TraceFormat), sizeof(TraceFormat));
+    os.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    os.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(TraceRecord));
+}
+
+std::vector<TraceRecord>
+Tracer::load(std::istream& is) {
+    char magic[sizeof(TraceMagic)];
+    uint32_t format = 0;
+    uint32_t count = 0;
+    is.read(magic, sizeof(magic));
+    is.read(reinterpret_cast<char*>(&format), sizeof(format));
+    is.read(reinterpret_cast<char*>(&count), sizeof(count));
+    if (!is || std::memcmp(magic, TraceMagic, sizeof(magic)) != 0) {
+        throw Exception("Not a jyq trace file!");
+    } else if (format != TraceFormat) {
+        throw Exception("Unsupported trace format ", format);
+    }
+    std::vector<TraceRecord> records(count);
+    if (!is.read(reinterpret_cast<char*>(records.data()), count * sizeof(TraceRecord))) {
+        throw Exception("Truncated trace file!");
+    }
+    return records;
+}
+
+void
+writeChromeTrace(std::ostream& os, const std::vector<TraceRecord>& records) {
+    auto first = records.empty() ? 0 : records.front().time;
+    auto separator = "";
+    os << "{\"traceEvents\":[";
+    for (const auto& r : records) {
+        auto event = TraceEvent(r.event);
+        char phase = 'i';
+        switch (event) {
+            case TraceEvent::Received: phase = 'b'; break;
+            case TraceEvent::Sent: phase = 'e'; break;
+            case TraceEvent::HandlerStart: phase = 'B'; break;
+            case TraceEvent::HandlerEnd: phase = 'E'; break;
+            default: break;
+        }
+        os << separator << "\n{\"name\":\"" << typeName(FType(r.type)) << "\""
+           << ",\"cat\":\"" << (phase == 'b' || phase == 'e' ? "request" : eventName(event)) << "\""
+           << ",\"ph\":\"" << phase << "\""
+           << ",\"ts\":" << (r.time - first) / 1000 << '.' << (r.time - first) % 1000 / 100
+           << ",\"pid\":1,\"tid\":" << r.thread;
+        if (phase == 'b' || phase == 'e') {
+            os << ",\"id\":" << r.tag;
+        } else if (phase == 'i') {
+            os << ",\"s\":\"t\"";
+        }
+        os << ",\"args\":{\"tag\":" << r.tag << ",\"fid\":" << r.fid << ",\"bytes\":" << r.bytes << "}}";
+        separator = ",";
+    }
+    os << "\n]}" << std::endl;
+}
+
+} // end namespace jyq
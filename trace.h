@@ -0,0 +1,117 @@
+#ifndef LIBJYQ_TRACE_H__
+#define LIBJYQ_TRACE_H__
+/* C++ Implementation copyright (c)2019 Joshua Scoggins
+ * See LICENSE file for license details.
+ */
+
+#include <array>
+#include <atomic>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <vector>
+#include "types.h"
+
+
+namespace jyq {
+    /**
+     * Type: TraceEvent
+     *
+     * The points in the life of a request which are traced. Received
+     * and Sent carry the size of the message in P<bytes>.
+     */
+    enum class TraceEvent : uint8_t {
+        Received,
+        Dispatched,
+        HandlerStart,
+        HandlerEnd,
+        Responded,
+        Sent,
+    };
+    const char* eventName(TraceEvent event) noexcept;
+    /**
+     * Type: TraceRecord
+     *
+     * One fixed size binary trace entry. P<time> is an F<nsec>
+     * timestamp and P<thread> numbers the ring which recorded it.
+     */
+    struct TraceRecord {
+        uint64_t time;
+        uint32_t thread;
+        uint32_t fid;
+        uint32_t bytes;
+        uint16_t tag;
+        uint8_t type;
+        uint8_t event;
+    };
+    static_assert(sizeof(TraceRecord) == 24);
+    /**
+     * Type: Tracer
+     *
+     * Request lifecycle tracing, off by default. Every thread that
+     * records an event gets its own ring of RingSize records, which it
+     * fills without taking a lock or formatting anything; once a ring
+     * is full the oldest records are overwritten. Rings outlive their
+     * threads so that their records can still be collected. While
+     * tracing is disabled F<trace> costs a single relaxed load.
+     *
+     * snapshot gathers the records still held by all rings, ordered by
+     * time, and save writes them in the binary format read by load.
+     * The jyqtrace tool converts such a file to Chrome trace JSON, see
+     * F<writeChromeTrace>.
+     */
+    class Tracer {
+        public:
+            static constexpr auto RingSize = 8192u;
+            static Tracer& global() noexcept { return _global; }
+            void enable(bool value = true) noexcept { _enabled.store(value, std::memory_order_relaxed); }
+            bool isEnabled() const noexcept { return _enabled.load(std::memory_order_relaxed); }
+            void record(TraceEvent event, FType type, uint16_t tag, uint32_t fid, uint32_t bytes) noexcept;
+            std::vector<TraceRecord> snapshot();
+            void save(std::ostream& os);
+            static std::vector<TraceRecord> load(std::istream& is);
+        private:
+            struct Ring {
+                explicit Ring(uint32_t id) : thread(id) { }
+                struct Slot {
+                    std::atomic<uint64_t> sequence { 0 }; /* index + 1 of the record in the slot */
+                    TraceRecord record;
+                };
+                uint32_t thread;
+                std::atomic<uint64_t> head { 0 };
+                std::array<Slot, RingSize> slots;
+            };
+            Tracer() = default;
+            Ring& local();
+        private:
+            static Tracer _global;
+            static thread_local Ring* _local; /* owned by _rings */
+            std::atomic<bool> _enabled { false };
+            Mutex _lock JYQ_LOCK_NAME("Tracer::_lock");
+            std::vector<std::shared_ptr<Ring>> _rings;
+    };
+    /**
+     * Function: trace
+     *
+     * Records a request lifecycle event in the ring of the calling
+     * thread when tracing is enabled.
+     */
+    inline void trace(TraceEvent event, FType type, uint16_t tag, uint32_t fid, uint32_t bytes = 0) noexcept {
+        if (auto& tracer = Tracer::global(); tracer.isEnabled()) {
+            tracer.record(event, type, tag, fid, bytes);
+        }
+    }
+    /**
+     * Function: writeChromeTrace
+     *
+     * Writes records as a Chrome trace event file, loadable in
+     * chrome://tracing or Perfetto. Each request becomes an async span
+     * from Received to Sent keyed by its tag, handler runs become
+     * duration events on the thread which ran them and the remaining
+     * events are instants. Sent must therefore be recorded with the
+     * type of the request rather than that of the reply.
+     */
+    void writeChromeTrace(std::ostream& os, const std::vector<TraceRecord>& records);
+} // end namespace jyq
+
+#endif // end LIBJYQ_TRACE_H__
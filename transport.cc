@@ -8,11 +8,14 @@
 #include <cstring>
 #include <sys/stat.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <unistd.h>
+#include <vector>
 #include "Msg.h"
 #include "jyq.h"
 #include "socket.h"
+#include "probes.h"
 
 namespace jyq {
 
@@ -33,6 +36,21 @@ namespace jyq {
  * 4 byte size specifier) into the buffer at P<msg>->data, so
  * long as the size is less than P<msg>->size.
  *
+ * The T<MsgChain> variant of sendmsg hands every segment of the
+ * chain to writev(2), so a message goes out without first being
+ * collected in a single buffer. Given P<stalled>, it writes to a
+ * socket without blocking, and calls P<stalled> to wait whenever
+ * the socket takes no more.
+ *
+ * The variant of recvmsg given P<payload> reads the first
+ * P<headLength> bytes of the message into P<head>, then lets
+ * P<payload> decide from them where the rest goes. It is read
+ * after the header in P<head> if P<payload> returns nullptr, and
+ * otherwise scattered across the segments of the returned chain
+ * with readv(2), so that a large payload lands directly in caller
+ * provided memory. The segments are filled in order and must be
+ * able to hold the rest of the message.
+ *
  * Returns:
  *	These functions return the number of bytes read or
  *	written, or 0 on error. Errors are stored in
@@ -85,6 +103,7 @@ Connection::sendmsg(Msg& msg) {
             msg.advancePosition(r);
         }
 	}
+    JYQ_PROBE(msg__send, _fid, msg.getPos() - msg.getData());
     return msg.getPos() - msg.getData();
 }
 
@@ -111,9 +130,130 @@ Connection::recvmsg(Msg& msg) {
         }
 
         msg.setEnd(msg.getPos());
+        JYQ_PROBE(msg__recv, _fid, msize);
+        return msize;
+    }
+}
+
+namespace {
+/* Drop the first count bytes from the front of a working iovec list */
+void
+consume(std::vector<iovec>& iov, size_t& first, size_t count) {
+    while (count > 0 && first < iov.size()) {
+        if (count >= iov[first].iov_len) {
+            count -= iov[first].iov_len;
+            ++first;
+        } else {
+            iov[first].iov_base = (char*)iov[first].iov_base + count;
+            iov[first].iov_len -= count;
+            count = 0;
+        }
+    }
+}
+} // end namespace
+
+size_t
+Connection::readv(MsgChain& chain, size_t count) {
+    std::vector<iovec> iov;
+    for (const auto& seg : chain.getSegments()) {
+        if (count == 0) {
+            break;
+        }
+        auto len = min<size_t>(seg.iov_len, count);
+        iov.push_back(iovec { seg.iov_base, len });
+        count -= len;
+    }
+    size_t total = 0;
+    for (size_t first = 0; first < iov.size();) {
+        auto r = ::readv(_fid, &iov[first], iov.size() - first);
+        if (r == -1 && errno == EINTR) {
+            continue;
+        }
+        if (r <= 0) {
+            throw Exception("broken pipe");
+        }
+        consume(iov, first, r);
+        total += r;
+    }
+    return total;
+}
+
+uint
+Connection::recvmsg(Msg& head, uint headLength, const Payload& payload) {
+    static constexpr auto SSize = 4u;
+
+    head.setMode(Msg::Mode::Unpack);
+    head.pointToFront();
+    head.setEnd(head.getData() + head.size());
+    if (readn(head, SSize) != SSize) {
+        return 0;
+    } else {
+        head.pointToFront();
+        uint32_t msize = 0;
+        head.pu32(&msize);
+        if (msize < SSize) {
+            throw Exception("message too small");
+        }
+        if (size_t(msize - SSize) >= size_t(head.getEnd() - head.getPos())) {
+            throw Exception("message too large");
+        }
+
+        uint32_t inHead = min<uint32_t>(msize, max<uint32_t>(headLength, SSize)) - SSize;
+        if (size_t(readn(head, inHead)) != inHead) {
+            throw Exception("message incomplete");
+        }
+        uint32_t rest = msize - SSize - inHead;
+        if (auto chain = rest > 0 ? payload(head, rest) : nullptr; !chain) {
+            if (size_t(readn(head, rest)) != rest) {
+                throw Exception("message incomplete");
+            }
+        } else if (rest > chain->size()) {
+            throw Exception("message too large");
+        } else if (readv(*chain, rest) != rest) {
+            throw Exception("message incomplete");
+        }
+        head.setEnd(head.getPos());
+        JYQ_PROBE(msg__recv, _fid, msize);
         return msize;
     }
 }
 
+uint
+Connection::sendmsg(MsgChain& chain, const std::function<void()>& stalled) {
+    auto iov = chain.getSegments();
+    size_t total = 0;
+    auto nonblocking = bool(stalled);
+    for (size_t first = 0; first < iov.size();) {
+        ssize_t r = 0;
+        if (nonblocking) {
+            msghdr hdr { };
+            hdr.msg_iov = &iov[first];
+            hdr.msg_iovlen = iov.size() - first;
+            r = ::sendmsg(_fid, &hdr, MSG_DONTWAIT);
+        } else {
+            r = ::writev(_fid, &iov[first], iov.size() - first);
+        }
+        if (r < 1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (nonblocking && errno == ENOTSOCK) {
+                // a pipe, say: block as before
+                nonblocking = false;
+                continue;
+            }
+            if (nonblocking && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                stalled();
+                continue;
+            }
+            throw Exception("broken pipe");
+        } else {
+            consume(iov, first, r);
+            total += r;
+        }
+    }
+    JYQ_PROBE(msg__send, _fid, total);
+    return total;
+}
 
 } // end namespace jyq
@@ -15,6 +15,9 @@
 #include <mutex>
 #include <condition_variable>
 #include <shared_mutex>
+#ifdef JYQ_LOCK_STATS
+#include "lockstats.h"
+#endif
 
 namespace jyq {
     using uint = unsigned int;
@@ -248,9 +251,18 @@ namespace jyq {
             std::any _aux;
 
     };
+#ifdef JYQ_LOCK_STATS
+    /* contention is recorded per lock, see lockstats.h */
+    using Mutex = InstrumentedMutex;
+    using Rendez = std::condition_variable_any;
+    using RWLock = InstrumentedRWLock;
+#define JYQ_LOCK_NAME(name) { name }
+#else
     using Mutex = std::mutex;
     using Rendez = std::condition_variable;
     using RWLock = std::shared_mutex;
+#define JYQ_LOCK_NAME(name) { }
+#endif
     using Lock = std::unique_lock<Mutex>;
 
     template<typename ... Args>
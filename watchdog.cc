@@ -0,0 +1,33 @@
+/* C++ Implementation copyright (c)2019 Joshua Scoggins
+ * See LICENSE file for license details.
+ */
+#include "watchdog.h"
+
+
+namespace jyq {
+void
+Watchdog::iteration(uint64_t elapsed) {
+    _loopLag.record(elapsed);
+    if (elapsed > _threshold) {
+        _loopStalls.fetch_add(1, std::memory_order_relaxed);
+        report(Stall { Stall::Kind::Loop, elapsed });
+    }
+}
+
+void
+Watchdog::handled(FType type, uint16_t tag, uint32_t fid, int fd, uint64_t elapsed) {
+    _handlerTime.record(elapsed);
+    if (elapsed > _threshold) {
+        _slowHandlers.fetch_add(1, std::memory_order_relaxed);
+        report(Stall { Stall::Kind::Handler, elapsed, type, tag, fid, fd });
+    }
+}
+
+void
+Watchdog::report(const Stall& stall) {
+    if (_onStall) {
+        _onStall(stall);
+    }
+}
+
+} // end namespace jyq
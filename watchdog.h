@@ -0,0 +1,73 @@
+#ifndef LIBJYQ_WATCHDOG_H__
+#define LIBJYQ_WATCHDOG_H__
+/* C++ Implementation copyright (c)2019 Joshua Scoggins
+ * See LICENSE file for license details.
+ */
+
+#include <atomic>
+#include <functional>
+#include "types.h"
+#include "stats.h"
+
+
+namespace jyq {
+    /**
+     * Type: Stall
+     *
+     * Describes a select loop iteration or an T<Srv9> callback which
+     * ran for longer than the threshold of a T<Watchdog>. Loop stalls
+     * leave P<type>, P<tag>, P<fid> and P<fd> unset.
+     */
+    struct Stall {
+        enum class Kind {
+            Loop,
+            Handler,
+        };
+        Kind kind;
+        uint64_t elapsed; /* nanoseconds */
+        FType type = FType::TError;
+        uint16_t tag = NoTag;
+        uint32_t fid = NoFid;
+        int fd = -1;
+    };
+    /**
+     * Type: Watchdog
+     *
+     * Times every iteration of F<serverloop>, from select(2) returning
+     * until it is called again, and every dispatch of a request to its
+     * T<Srv9> callback. Both go into histograms. Any that take longer
+     * than the threshold are counted and passed to the P<onStall>
+     * callback, which is run on the loop thread right after the
+     * offender and should be quick.
+     *
+     * Install one with P<Server::setWatchdog>.
+     *
+     * See also:
+     *	T<Server>, T<LatencyHistogram>
+     */
+    class Watchdog {
+        public:
+            using Callback = std::function<void(const Stall&)>;
+            explicit Watchdog(uint64_t threshold = 10 * 1000 * 1000, Callback onStall = nullptr) : _threshold(threshold), _onStall(onStall) { }
+            constexpr auto getThreshold() const noexcept { return _threshold; }
+            void setThreshold(uint64_t value) noexcept { _threshold = value; }
+            void setOnStall(Callback value) { _onStall = value; }
+            void iteration(uint64_t elapsed);
+            void handled(FType type, uint16_t tag, uint32_t fid, int fd, uint64_t elapsed);
+            const LatencyHistogram& getLoopLag() const noexcept { return _loopLag; }
+            const LatencyHistogram& getHandlerTime() const noexcept { return _handlerTime; }
+            uint64_t getLoopStalls() const noexcept { return _loopStalls.load(std::memory_order_relaxed); }
+            uint64_t getSlowHandlers() const noexcept { return _slowHandlers.load(std::memory_order_relaxed); }
+        private:
+            void report(const Stall& stall);
+        private:
+            uint64_t _threshold; /* nanoseconds */
+            Callback _onStall;
+            LatencyHistogram _loopLag;
+            LatencyHistogram _handlerTime;
+            std::atomic<uint64_t> _loopStalls { 0 };
+            std::atomic<uint64_t> _slowHandlers { 0 };
+    };
+} // end namespace jyq
+
+#endif // end LIBJYQ_WATCHDOG_H__